@@ -10,16 +10,786 @@
 
 #include "oDLNode.h"
 
+////////////////////////////////////////////////
+// oDLSortKeys
+////////////////////////////////////////////////
+
+oDLSortKeys::oDLSortKeys(void) {
+	mRowCount = 0;
+};
+
+// number of columns we sort on
+unsigned long	oDLSortKeys::columnCount(void) const {
+	return mColumns.size();
+};
+
+// parse our sort columns, i.e. "3,-2" sorts on column 3 ascending and then column 2 descending
+void	oDLSortKeys::setColumns(const qstring & pColumns) {
+	qlong	column = 0;
+	bool	descending = false;
+	
+	mColumns.clear();
+	mDescending.clear();
+	clear();
+	
+	for (qulong i = 0; i <= pColumns.length(); i++) {
+		qchar	digit = i < pColumns.length() ? pColumns[i] : ',';
+		
+		if (digit == ',') {
+			if (column > 0) {
+				mColumns.push_back(column);
+				mDescending.push_back(descending);
+			};
+			column		= 0;
+			descending	= false;
+		} else if (digit == '-') {
+			descending = true;
+		} else if ((digit >= '0') && (digit <= '9')) {
+			column = 10 * column;
+			column += digit - '0';
+		};
+	};
+};
+
+// return our sort columns as a string
+void	oDLSortKeys::columnsAsString(qstring & pColumns) const {
+	pColumns = QTEXT("");
+	
+	for (unsigned long i = 0; i < mColumns.size(); i++) {
+		if (i != 0) {
+			pColumns += QTEXT(",");
+		};
+		pColumns.appendFormattedString(mDescending[i] ? "-%li" : "%li", mColumns[i]);
+	};
+};
+
+// clear our keys
+void	oDLSortKeys::clear(void) {
+	mKeys.clear();
+	mStrings.clear();
+	mRowCount = 0;
+};
+
+// extract our keys from our list
+void	oDLSortKeys::extract(EXTqlist * pList, qlong pRowCount) {
+	unsigned long	columns = mColumns.size();
+	qlong			colCount = pList->colCnt();
+	
+	clear();
+	
+	// line numbers start at 1, we simply leave the entries for line 0 empty
+	mRowCount = pRowCount;
+	mKeys.resize((pRowCount + 1) * columns);
+	
+	for (unsigned long c = 0; c < columns; c++) {
+		qlong	column = mColumns[c];
+		
+		for (qlong lineno = 1; lineno <= pRowCount; lineno++) {
+			sDLSortKey &	key = mKeys[(lineno * columns) + c];
+			
+			key.mNumber = 0;
+			key.mString = -1;
+			
+			if (column <= colCount) {
+				EXTfldval	colFld;
+				ffttype		type;
+				
+				pList->getColValRef(lineno, column, colFld, qfalse);
+				colFld.getType(type);
+				
+				switch (type) {
+					case fftNumber:
+					case fftInteger:
+					case fftBoolean: {
+						key.mNumber = colFld.getNum();
+					}; break;
+					case fftDate: {
+						datestamptype	date;
+						qbool			success;
+						
+						colFld.getDate(date, dpFdtimeC, &success);
+						if (success && date.mDateOk) {
+							// we only need this to be ordered the same way as our dates, not to be an actual day count
+							key.mNumber = ((date.mYear * 372.0) + (date.mMonth * 31.0) + date.mDay) * 8640000.0;
+							if (date.mTimeOk) {
+								key.mNumber += (((date.mHour * 60.0) + date.mMin) * 60.0 + (date.mSecOk ? date.mSec : 0)) * 100.0 + (date.mHunOk ? date.mHun : 0);
+							};
+						} else {
+							// empty dates go first
+							key.mNumber = -1;
+						};
+					}; break;
+					default: {
+						// compare our strings case insensitive, we fold them once here so our compare is a straight compare
+						qstring	value(colFld);
+						oDLKey	folded = oDLNode::keyFromString(value);
+						oDLNode::foldKey(folded);
+						
+						key.mString = mStrings.size();
+						mStrings.push_back(folded);
+					}; break;
+				};
+			};
+		};
+	};
+};
+
+// compare two lines, <0 if A goes first, >0 if B goes first, 0 if equal
+int		oDLSortKeys::compare(qlong pLineA, qlong pLineB) const {
+	unsigned long	columns = mColumns.size();
+	
+	if ((pLineA <= 0) || (pLineB <= 0) || (pLineA > mRowCount) || (pLineB > mRowCount)) {
+		// no keys for these..
+		return 0;
+	};
+	
+	const sDLSortKey *	keysA = &mKeys[pLineA * columns];
+	const sDLSortKey *	keysB = &mKeys[pLineB * columns];
+	
+	for (unsigned long c = 0; c < columns; c++) {
+		int		result = 0;
+		
+		if ((keysA[c].mString == -1) && (keysB[c].mString == -1)) {
+			result = keysA[c].mNumber < keysB[c].mNumber ? -1 : (keysA[c].mNumber > keysB[c].mNumber ? 1 : 0);
+		} else if (keysA[c].mString == -1) {
+			// numbers before strings
+			result = -1;
+		} else if (keysB[c].mString == -1) {
+			result = 1;
+		} else {
+			result = mStrings[keysA[c].mString].compare(mStrings[keysB[c].mString]);
+		};
+		
+		if (result != 0) {
+			return mDescending[c] ? -result : result;
+		};
+	};
+	
+	return 0;
+};
+
+// 64bit hash over our keys so we can tell if the values we sort on changed
+unsigned long long	oDLSortKeys::fingerprint(void) const {
+	unsigned long long	hash = 14695981039346656037ULL;
+	
+	oDLStateStream::hashLong(hash, mColumns.size());
+	for (unsigned long i = 0; i < mColumns.size(); i++) {
+		oDLStateStream::hashLong(hash, mDescending[i] ? -mColumns[i] : mColumns[i]);
+	};
+	for (unsigned long i = 0; i < mKeys.size(); i++) {
+		if (mKeys[i].mString == -1) {
+			const unsigned char *	bytes = (const unsigned char *) &mKeys[i].mNumber;
+			for (size_t b = 0; b < sizeof(qreal); b++) {
+				hash ^= bytes[b];
+				hash *= 1099511628211ULL;
+			};
+		} else {
+			const oDLKey &	string = mStrings[mKeys[i].mString];
+			
+			oDLStateStream::hashLong(hash, string.length());
+			for (size_t c = 0; c < string.length(); c++) {
+				hash ^= (unsigned long long) string[c];
+				hash *= 1099511628211ULL;
+			};
+		};
+	};
+	
+	return hash;
+};
+
+// do we hold the same keys as pOther?
+bool	oDLSortKeys::matches(const oDLSortKeys & pOther) const {
+	if ((mRowCount != pOther.mRowCount) || (mColumns != pOther.mColumns) || (mDescending != pOther.mDescending) || (mKeys.size() != pOther.mKeys.size()) || (mStrings != pOther.mStrings)) {
+		return false;
+	};
+	
+	for (unsigned long i = 0; i < mKeys.size(); i++) {
+		// we add our strings in the order we find them so equal data gives equal string indexes
+		if ((mKeys[i].mString != pOther.mKeys[i].mString) || ((mKeys[i].mString == -1) && (mKeys[i].mNumber != pOther.mKeys[i].mNumber))) {
+			return false;
+		};
+	};
+	
+	return true;
+};
+
+// swap our keys with pOther
+void	oDLSortKeys::swap(oDLSortKeys & pOther) {
+	qlong	rowCount = mRowCount;
+	
+	mColumns.swap(pOther.mColumns);
+	mDescending.swap(pOther.mDescending);
+	mKeys.swap(pOther.mKeys);
+	mStrings.swap(pOther.mStrings);
+	mRowCount = pOther.mRowCount;
+	pOther.mRowCount = rowCount;
+};
+
+////////////////////////////////////////////////
+// sDLSnapshot
+////////////////////////////////////////////////
+
+// 64bit hash over our lines and values so we can tell if our data changed
+unsigned long long	sDLSnapshot::fingerprint(void) const {
+	unsigned long long	hash = 14695981039346656037ULL;
+	
+	oDLStateStream::hashLong(hash, mColumns);
+	oDLStateStream::hashLong(hash, mLines.size());
+	for (unsigned long i = 0; i < mLines.size(); i++) {
+		oDLStateStream::hashLong(hash, mLines[i]);
+	};
+	for (unsigned long i = 0; i < mValues.size(); i++) {
+		oDLStateStream::hashLong(hash, mValues[i].length());
+		for (size_t c = 0; c < mValues[i].length(); c++) {
+			hash ^= (unsigned long long) mValues[i][c];
+			hash *= 1099511628211ULL;
+		};
+	};
+	
+	return hash;
+};
+
+// do we hold the same lines and values as pOther?
+bool	sDLSnapshot::matches(const sDLSnapshot & pOther) const {
+	return (mColumns == pOther.mColumns) && (mLines == pOther.mLines) && (mValues == pOther.mValues);
+};
+
+// swap our lines and values with pOther
+void	sDLSnapshot::swap(sDLSnapshot & pOther) {
+	unsigned long	columns = mColumns;
+	
+	mColumns = pOther.mColumns;
+	pOther.mColumns = columns;
+	mLines.swap(pOther.mLines);
+	mValues.swap(pOther.mValues);
+};
+
+////////////////////////////////////////////////
+// sDLModelKey
+////////////////////////////////////////////////
+
+// were we built from the same data with the same settings as pOther?
+bool	sDLModelKey::matches(const sDLModelKey & pOther) const {
+	// our hash rules out nearly everything, we only compare our data to make sure
+	return (mHash == pOther.mHash) && (mAdjacency == pOther.mAdjacency) && (mColumns == pOther.mColumns) && mSnapshot.matches(pOther.mSnapshot) && mSortKeys.matches(pOther.mSortKeys);
+};
+
+// swap our contents with pOther
+void	sDLModelKey::swap(sDLModelKey & pOther) {
+	unsigned long long	hash = mHash;
+	bool				adjacency = mAdjacency;
+	
+	mHash = pOther.mHash;
+	pOther.mHash = hash;
+	mAdjacency = pOther.mAdjacency;
+	pOther.mAdjacency = adjacency;
+	mColumns.swap(pOther.mColumns);
+	mSnapshot.swap(pOther.mSnapshot);
+	mSortKeys.swap(pOther.mSortKeys);
+};
+
+////////////////////////////////////////////////
+// oDLRowCache
+////////////////////////////////////////////////
+
+oDLRowCache::oDLRowCache(qlong pPageSize) {
+	mPageSize	= pPageSize > 0 ? pPageSize : 1;
+	mColumns	= 1;
+};
+
+oDLRowCache::~oDLRowCache(void) {
+	clear();
+};
+
+// get a page, creating it if needed
+sDLCachePage *	oDLRowCache::getPage(qlong pPage) {
+	std::map<qlong, sDLCachePage *>::iterator	it = mPages.find(pPage);
+	if (it != mPages.end()) {
+		return it->second;
+	};
+	
+	sDLCachePage *	page = new sDLCachePage();
+	page->mValues.resize(mPageSize * mColumns);
+	page->mLoaded.resize(mPageSize, false);
+	mPages[pPage] = page;
+	
+	return page;
+};
+
+// number of rows in a page
+qlong	oDLRowCache::pageSize(void) const {
+	return mPageSize;
+};
+
+// page containing this row, rows start at 1
+qlong	oDLRowCache::pageOf(qlong pRow) const {
+	return (pRow - 1) / mPageSize;
+};
+
+// number of columns in a row
+unsigned long	oDLRowCache::columnCount(void) const {
+	return mColumns;
+};
+
+// set our number of columns, this clears our cache
+void	oDLRowCache::setColumnCount(unsigned long pColumns) {
+	clear();
+	mColumns = pColumns > 0 ? pColumns : 1;
+};
+
+// remove all our pages
+void	oDLRowCache::clear(void) {
+	std::map<qlong, sDLCachePage *>::iterator	it;
+	for (it = mPages.begin(); it != mPages.end(); it++) {
+		delete it->second;
+	};
+	mPages.clear();
+};
+
+// returns true if we don't have this page yet and it should be requested, it won't be requested again until it is evicted
+bool	oDLRowCache::requestPage(qlong pPage) {
+	if (mPages.find(pPage) != mPages.end()) {
+		// already loaded or already requested
+		return false;
+	};
+	
+	getPage(pPage);
+	return true;
+};
+
+// returns true if we have the values for this row
+bool	oDLRowCache::isLoaded(qlong pRow) const {
+	if (pRow < 1) {
+		return false;
+	};
+	
+	std::map<qlong, sDLCachePage *>::const_iterator	it = mPages.find(pageOf(pRow));
+	if (it == mPages.end()) {
+		return false;
+	};
+	
+	return it->second->mLoaded[(pRow - 1) % mPageSize];
+};
+
+// value for this row, only valid if isLoaded returns true
+const qstring &	oDLRowCache::value(qlong pRow, unsigned long pColumn) const {
+	const sDLCachePage *	page = mPages.find(pageOf(pRow))->second;
+	
+	return page->mValues[(((pRow - 1) % mPageSize) * mColumns) + pColumn];
+};
+
+// set the value for this row
+void	oDLRowCache::setValue(qlong pRow, unsigned long pColumn, const qstring & pValue) {
+	if ((pRow < 1) || (pColumn >= mColumns)) {
+		return;
+	};
+	
+	sDLCachePage *	page = getPage(pageOf(pRow));
+	qlong			index = (pRow - 1) % mPageSize;
+	
+	page->mValues[(index * mColumns) + pColumn] = pValue;
+	page->mLoaded[index] = true;
+};
+
+// remove pages that fall completely outside of these rows
+void	oDLRowCache::evict(qlong pFirstRow, qlong pLastRow) {
+	qlong	firstPage = pageOf(pFirstRow > 1 ? pFirstRow : 1);
+	qlong	lastPage = pageOf(pLastRow > 1 ? pLastRow : 1);
+	
+	std::map<qlong, sDLCachePage *>::iterator	it = mPages.begin();
+	while (it != mPages.end()) {
+		if ((it->first < firstPage) || (it->first > lastPage)) {
+			delete it->second;
+			mPages.erase(it++);
+		} else {
+			it++;
+		};
+	};
+};
+
+////////////////////////////////////////////////
+// oDLSelection
+////////////////////////////////////////////////
+
+oDLSelection::oDLSelection(void) {
+	mRowCount = 0;
+};
+
+// number of lines in our list
+qlong	oDLSelection::rowCount(void) const {
+	return mRowCount;
+};
+
+// load the selection state from our list
+void	oDLSelection::load(EXTqlist * pList) {
+	mRowCount = pList->rowCnt();
+	mBits.assign((mRowCount + 63) / 64, 0);
+	
+	for (qlong line = 1; line <= mRowCount; line++) {
+		if (pList->isRowSelected(line, qfalse)) {
+			mBits[(line - 1) >> 6] |= 1ULL << ((line - 1) & 63);
+		};
+	};
+	
+	mPushed = mBits;
+};
+
+// update the lines in our list whose selection state we changed, returns the number of lines updated
+qlong	oDLSelection::push(EXTqlist * pList) {
+	qlong	updated = 0;
+	
+	for (unsigned long word = 0; word < mBits.size(); word++) {
+		unsigned long long	changed = mBits[word] ^ mPushed[word];
+		
+		// skip over words that haven't changed, usually most of them
+		for (int bit = 0; changed != 0; bit++, changed >>= 1) {
+			if (changed & 1) {
+				qlong	line = (word << 6) + bit + 1;
+				
+				pList->selectRow(line, isSelected(line) ? qtrue : qfalse, qfalse);
+				updated++;
+			};
+		};
+	};
+	
+	mPushed = mBits;
+	return updated;
+};
+
+// is this line selected?
+bool	oDLSelection::isSelected(qlong pLineNo) const {
+	if ((pLineNo < 1) || (pLineNo > mRowCount)) {
+		return false;
+	};
+	
+	return (mBits[(pLineNo - 1) >> 6] & (1ULL << ((pLineNo - 1) & 63))) != 0;
+};
+
+// select or deselect a single line
+void	oDLSelection::select(qlong pLineNo, bool pSelect) {
+	selectRange(pLineNo, pLineNo, pSelect);
+};
+
+// select or deselect all lines from pFrom up to and including pTo, whole words at a time
+void	oDLSelection::selectRange(qlong pFrom, qlong pTo, bool pSelect) {
+	if (pFrom > pTo) {
+		qlong	swap = pFrom;
+		pFrom = pTo;
+		pTo = swap;
+	};
+	pFrom	= pFrom < 1 ? 1 : pFrom;
+	pTo		= pTo > mRowCount ? mRowCount : pTo;
+	
+	while (pFrom <= pTo) {
+		unsigned long		word = (pFrom - 1) >> 6;
+		int					first = (pFrom - 1) & 63;
+		int					last = ((pTo - 1) >> 6) == (qlong) word ? (pTo - 1) & 63 : 63;
+		unsigned long long	mask = (last == 63 ? ~0ULL : ((1ULL << (last + 1)) - 1)) & (~0ULL << first);
+		
+		if (pSelect) {
+			mBits[word] |= mask;
+		} else {
+			mBits[word] &= ~mask;
+		};
+		
+		pFrom += last - first + 1;
+	};
+};
+
+// select or deselect all lines
+void	oDLSelection::selectAll(bool pSelect) {
+	selectRange(1, mRowCount, pSelect);
+};
+
+////////////////////////////////////////////////
+// oDLPrefixIndex
+////////////////////////////////////////////////
+
+oDLPrefixIndex::oDLPrefixIndex(void) {
+	mColumn		= 0;
+	mRowCount	= 0;
+};
+
+// is our index built for this column and number of lines?
+bool	oDLPrefixIndex::isBuiltFor(qlong pColumn, qlong pRowCount) const {
+	return (mColumn != 0) && (mColumn == pColumn) && (mRowCount == pRowCount);
+};
+
+// clear our index, it will be rebuilt on the next find
+void	oDLPrefixIndex::clear(void) {
+	mColumn		= 0;
+	mRowCount	= 0;
+	mEntries.clear();
+};
+
+// start building our index
+void	oDLPrefixIndex::start(qlong pColumn, qlong pRowCount) {
+	clear();
+	mColumn		= pColumn;
+	mRowCount	= pRowCount;
+	mEntries.reserve(pRowCount);
+};
+
+// add the display value for a line
+void	oDLPrefixIndex::add(const qstring & pText, qlong pLineNo) {
+	sDLPrefixEntry	entry;
+	
+	entry.mText		= oDLNode::keyFromString(pText);
+	entry.mLineNo	= pLineNo;
+	oDLNode::foldKey(entry.mText);
+	
+	mEntries.push_back(entry);
+};
+
+// sort our entries
+void	oDLPrefixIndex::finish(void) {
+	std::sort(mEntries.begin(), mEntries.end());
+};
+
+// find the entries starting with this folded prefix, pFirst == pLast if there are none
+void	oDLPrefixIndex::findRange(const oDLKey & pPrefix, size_t & pFirst, size_t & pLast) const {
+	sDLPrefixEntry	entry;
+	
+	entry.mText		= pPrefix;
+	entry.mLineNo	= 0;
+	pFirst	= std::lower_bound(mEntries.begin(), mEntries.end(), entry) - mEntries.begin();
+	pLast	= std::upper_bound(mEntries.begin() + pFirst, mEntries.end(), pPrefix, sDLPrefixCompare()) - mEntries.begin();
+};
+
+// line number of an entry
+qlong	oDLPrefixIndex::lineAt(size_t pIndex) const {
+	return mEntries[pIndex].mLineNo;
+};
+
+////////////////////////////////////////////////
+// oDLStateStream
+////////////////////////////////////////////////
+
+// start an empty stream for writing
+oDLStateStream::oDLStateStream(void) {
+	mPos	= 0;
+	mFailed	= false;
+};
+
+// start a stream for reading pData
+oDLStateStream::oDLStateStream(const qbyte * pData, size_t pLength) : mData(pData, pData + pLength) {
+	mPos	= 0;
+	mFailed	= false;
+};
+
+// our data
+const std::vector<qbyte> &	oDLStateStream::data(void) const {
+	return mData;
+};
+
+// did a read fail?
+bool	oDLStateStream::failed(void) const {
+	return mFailed;
+};
+
+// have we read all our data?
+bool	oDLStateStream::atEnd(void) const {
+	return mPos >= mData.size();
+};
+
+// write a 32bit value, we always write little endian so our state can move between platforms
+void	oDLStateStream::putLong(qlong pValue) {
+	unsigned long	value = (unsigned long) pValue;
+	
+	for (int i = 0; i < 4; i++) {
+		mData.push_back((qbyte) ((value >> (i * 8)) & 0xFF));
+	};
+};
+
+// write a 64bit value
+void	oDLStateStream::putHash(unsigned long long pValue) {
+	for (int i = 0; i < 8; i++) {
+		mData.push_back((qbyte) ((pValue >> (i * 8)) & 0xFF));
+	};
+};
+
+// write a string, qchar differs in size between platforms so we write each character as a 32bit value
+void	oDLStateStream::putString(const qstring & pValue) {
+	const qchar *	chars = pValue.cString();
+	qlong			len = pValue.length();
+	
+	putLong(len);
+	for (qlong i = 0; i < len; i++) {
+		putLong((qlong) chars[i]);
+	};
+};
+
+// read a 32bit value
+qlong	oDLStateStream::getLong(void) {
+	unsigned long	value = 0;
+	
+	if (mFailed || (mData.size() - mPos < 4)) {
+		mFailed = true;
+		return 0;
+	};
+	
+	for (int i = 0; i < 4; i++) {
+		value |= ((unsigned long) mData[mPos++]) << (i * 8);
+	};
+	
+	return (qlong) value;
+};
+
+// read a 64bit value
+unsigned long long	oDLStateStream::getHash(void) {
+	unsigned long long	value = 0;
+	
+	if (mFailed || (mData.size() - mPos < 8)) {
+		mFailed = true;
+		return 0;
+	};
+	
+	for (int i = 0; i < 8; i++) {
+		value |= ((unsigned long long) mData[mPos++]) << (i * 8);
+	};
+	
+	return value;
+};
+
+// read a string
+void	oDLStateStream::getString(qstring & pValue) {
+	qlong	len = getLong();
+	
+	pValue = QTEXT("");
+	if ((len < 0) || ((size_t) len > (mData.size() - mPos) / 4)) {
+		// can't be right, don't allocate for it
+		mFailed = true;
+		return;
+	};
+	
+	for (qlong i = 0; i < len; i++) {
+		pValue += (qchar) getLong();
+	};
+};
+
+// add a value to a 64bit FNV-1a hash, unlike std::hash this is the same between sessions
+void	oDLStateStream::hashLong(unsigned long long & pHash, qlong pValue) {
+	unsigned long	value = (unsigned long) pValue;
+	
+	for (int i = 0; i < 4; i++) {
+		pHash ^= (value >> (i * 8)) & 0xFF;
+		pHash *= 1099511628211ULL;
+	};
+};
+
+// add a string to a 64bit FNV-1a hash
+void	oDLStateStream::hashString(unsigned long long & pHash, const qstring & pValue) {
+	const qchar *	chars = pValue.cString();
+	qlong			len = pValue.length();
+	
+	hashLong(pHash, len);
+	for (qlong i = 0; i < len; i++) {
+		pHash ^= (unsigned long long) chars[i];
+		pHash *= 1099511628211ULL;
+	};
+};
+
+////////////////////////////////////////////////
+// oDLGroupBucket
+////////////////////////////////////////////////
+
+oDLGroupBucket::oDLGroupBucket(void) {
+	mFirstLine = 0;
+};
+
+oDLGroupBucket::~oDLGroupBucket(void) {
+	std::map<oDLKey, oDLGroupBucket *>::iterator it;
+	
+	for (it = mChildren.begin(); it != mChildren.end(); it++) {
+		delete it->second;
+	};
+};
+
+// add a line following its group values, empty values skip a level
+void	oDLGroupBucket::addLine(const oDLKey * pValues, unsigned long pLevels, qlong pLineNo) {
+	oDLGroupBucket *	bucket = this;
+	
+	for (unsigned long level = 0; level < pLevels; level++) {
+		if (pValues[level].length() > 0) {
+			oDLGroupBucket * &	child = bucket->mChildren[pValues[level]];
+			
+			if (child == NULL) {
+				// lines come in order so this is the first line for this group
+				child = new oDLGroupBucket();
+				child->mFirstLine = pLineNo;
+			};
+			
+			bucket = child;
+		};
+	};
+	
+	bucket->mLines.push_back(pLineNo);
+};
+
+// merge the groups of another bucket into ours, pOther must contain later lines
+void	oDLGroupBucket::merge(oDLGroupBucket & pOther) {
+	std::map<oDLKey, oDLGroupBucket *>::iterator it;
+	
+	mLines.insert(mLines.end(), pOther.mLines.begin(), pOther.mLines.end());
+	pOther.mLines.clear();
+	
+	for (it = pOther.mChildren.begin(); it != pOther.mChildren.end(); it++) {
+		oDLGroupBucket * &	child = mChildren[it->first];
+		
+		if (child == NULL) {
+			// new group, just take it over
+			child = it->second;
+		} else {
+			child->merge(*it->second);
+			delete it->second;
+		};
+	};
+	pOther.mChildren.clear();
+};
+
+// create nodes for our groups and lines, stops early once pCancel is set
+void	oDLGroupBucket::buildNodes(oDLNode & pParent, oAtomic * pCancel) {
+	std::map<oDLKey, oDLGroupBucket *>::iterator it;
+	
+	for (it = mChildren.begin(); it != mChildren.end(); it++) {
+		if ((pCancel != NULL) && (pCancel->get() != 0)) {
+			// no longer needed
+			return;
+		};
+		
+		qstring		description;
+		oDLNode::keyToString(it->first, description);
+		
+		oDLNode *	node = new oDLNode(qstring(QTEXT("")), description, 0);
+		node->setSortOrder(it->second->mFirstLine);
+		pParent.addNode(node);
+		
+		it->second->buildNodes(*node, pCancel);
+	};
+	
+	for (unsigned long index = 0; index < mLines.size(); index++) {
+		if (((index & 1023) == 0) && (pCancel != NULL) && (pCancel->get() != 0)) {
+			// no longer needed
+			return;
+		};
+		
+		oDLNode *	node = new oDLNode(qstring(QTEXT("")), qstring(QTEXT("")), mLines[index]);
+		node->setSortOrder(mLines[index]);
+		pParent.addNode(node);
+	};
+};
+
+////////////////////////////////////////////////
+// oDLNode
+////////////////////////////////////////////////
+
 oDLNode::oDLNode(void) {
 	mTouched		= true;
 	mExpanded		= true;
 	mLineNo			= 0;
 	mValue			= QTEXT("");
 	mDescription	= QTEXT("");
-	mTop			= 0;
-	mBottom			= 0;
 	mSortOrder		= 0;
-	mListLineNo		= -1;
 };
 
 oDLNode::oDLNode(const qstring & pValue, const qstring & pDescription, qlong pLineNo) {
@@ -28,10 +798,7 @@ oDLNode::oDLNode(const qstring & pValue, const qstring & pDescription, qlong pLi
 	mLineNo			= pLineNo;
 	mValue			= pValue;
 	mDescription	= pDescription;
-	mTop			= 0;
-	mBottom			= 0;	
 	mSortOrder		= 0;
-	mListLineNo		= -1;
 };
 
 oDLNode::~oDLNode(void) {
@@ -82,50 +849,6 @@ void	oDLNode::setSortOrder(qlong pSortOrder) {
 	mSortOrder = pSortOrder;
 };
 
-////////////////////////////////////////////////
-// for our drawing
-////////////////////////////////////////////////
-
-// drawn as visible line no
-qlong	oDLNode::listLineNo(void) {
-	return mListLineNo;
-};
-
-// set visible line no
-void	oDLNode::setListLineNo(qlong pLineNo) {
-	mListLineNo=pLineNo;
-};
-
-// top of our node
-qdim	oDLNode::top(void) {
-	return mTop;
-};
-
-// set the top of our node
-void	oDLNode::setTop(qdim pTop) {
-	mTop = pTop;
-};
-
-// bottom of our node
-qdim	oDLNode::bottom(void) {
-	return mBottom;
-};
-
-// set bottom of our node
-void	oDLNode::setBottom(qdim pBottom) {
-	mBottom = pBottom;
-};
-
-// our tree icon rectangle
-qrect	oDLNode::treeIconRect(void) {
-	return mTreeIconRect;
-};
-
-// set our tree icon rectangle
-void	oDLNode::setTreeIconRect(qrect pRect) {
-	mTreeIconRect = pRect;
-};
-
 ////////////////////////////////////////////////
 // read only info
 ////////////////////////////////////////////////
@@ -140,15 +863,6 @@ const qstring &	oDLNode::description(void) {
 	return mDescription;
 };
 
-// is this point within our tree icon?
-bool	oDLNode::aboveTreeIcon(qpoint pAt) {
-	if (mChildNodes.size()==0) {
-		return false;
-	} else {
-		return ((mTreeIconRect.left <= pAt.h) && (mTreeIconRect.right >= pAt.h) && (mTreeIconRect.top <= pAt.v) && (mTreeIconRect.bottom >= pAt.v));		
-	};
-};
-
 ////////////////////////////////////////////////
 // methods
 ////////////////////////////////////////////////
@@ -210,24 +924,6 @@ oDLNode	*	oDLNode::findChildByLineNo(qlong pLineNo, bool pNoValue) {
 	return NULL;
 };
 
-// Find a child node by screen location
-oDLNode *	oDLNode::findChildByPoint(qpoint pAt) {
-	for (unsigned long index = 0; index < mChildNodes.size(); index++) {
-		oDLNode *child = mChildNodes[index];
-		if ((child->mTop <= pAt.v) && (child->mBottom > pAt.v)) {
-			// Our point lies within this child, see if it lies within one of its children
-			oDLNode *subchild = child->findChildByPoint(pAt);
-			if (subchild != NULL) {
-				return subchild;
-			};
-			
-			return child;
-		};
-	};
-	
-	return NULL;
-};
-
 // Get child at specific index
 oDLNode *	oDLNode::getChildByIndex(unsigned long pIndex) {
 	if (pIndex < mChildNodes.size()) {
@@ -237,50 +933,34 @@ oDLNode *	oDLNode::getChildByIndex(unsigned long pIndex) {
 	};
 };
 
-// Get our list line no for a line in our source list
-qlong	oDLNode::findListLineNo(qlong pLineNo) {
-	if (mLineNo == pLineNo) {
-		return mListLineNo;
-	};
-	
-	if (mExpanded) {
-		// check our child nodes..
-		for (unsigned long index = 0; index < mChildNodes.size(); index++) {
-			oDLNode *child = mChildNodes[index];
-			qlong	listLineNo = child->findListLineNo(pLineNo);
-			if (listLineNo>=0) {
-				// found it!
-				return listLineNo;
-			};
-		};
-	} else {
-		// not expanded? then we're not showing anything..
-	};
-	
-	return -1;
+// Swap our child nodes with those of another node
+void	oDLNode::swapChildNodes(oDLNode & pOther) {
+	mChildNodes.swap(pOther.mChildNodes);
 };
 
-// Find top position for specific line (will check child nodes if applicable)
-qdim	oDLNode::findTopForLine(qlong pLineNo) {
-	if (mLineNo == pLineNo) {
-		return mTop;
+// Copy the expanded state of matching nodes in an older tree
+void	oDLNode::copyExpandedFrom(oDLNode & pOld) {
+	if ((mChildNodes.size()==0) || (pOld.mChildNodes.size()==0)) {
+		// nothing to match
+		return;
 	};
 	
-	if (mExpanded) {
-		// check our child nodes..
-		for (unsigned long index = 0; index < mChildNodes.size(); index++) {
-			oDLNode *child = mChildNodes[index];
-			qdim	top = child->findTopForLine(pLineNo);
-			if (top>=0) {
-				// found it!
-				return top;
-			};
-		};
-	} else {
-		// not expanded? then we're not showing anything..
+	// index the old children once so matching is linear
+	std::map<oDLKey, oDLNode *>	oldNodes;
+	for (unsigned long index = 0; index < pOld.mChildNodes.size(); index++) {
+		oDLNode *child = pOld.mChildNodes[index];
+		oldNodes.insert(std::make_pair(child->nodeKey(), child));
 	};
 	
-	return -1; // our positions start at the top..
+	for (unsigned long index = 0; index < mChildNodes.size(); index++) {
+		oDLNode *child = mChildNodes[index];
+		std::map<oDLKey, oDLNode *>::iterator found = oldNodes.find(child->nodeKey());
+		
+		if (found != oldNodes.end()) {
+			child->setExpanded(found->second->expanded());
+			child->copyExpandedFrom(*found->second);
+		};
+	};
 };
 
 // Static function that returns whether true if the sort order of A is smaller then B
@@ -294,16 +974,46 @@ bool	oDLNode::order(oDLNode * pA, oDLNode * pB) {
 	return pA->mSortOrder < pB->mSortOrder;
 };
 
-// Sort our child nodes
-void	oDLNode::sortChildren(void) {
+// Compare function object used when sorting by our sort keys
+struct sDLKeyOrder {
+	const oDLSortKeys *	mKeys;
+	
+	bool operator()(oDLNode * pA, oDLNode * pB) const {
+		// groups are sorted on the first line that belongs to them, lines on themselves
+		qlong	lineA = pA->lineNo() != 0 ? pA->lineNo() : pA->sortOrder();
+		qlong	lineB = pB->lineNo() != 0 ? pB->lineNo() : pB->sortOrder();
+		int		result = mKeys->compare(lineA, lineB);
+		
+		if (result != 0) {
+			return result < 0;
+		};
+		
+		return oDLNode::order(pA, pB);
+	};
+};
+
+// Sort our child nodes, by our sort keys if specified, stops early once pCancel is set
+void	oDLNode::sortChildren(const oDLSortKeys * pKeys, oAtomic * pCancel) {
+	if ((pCancel != NULL) && (pCancel->get() != 0)) {
+		// no longer needed
+		return;
+	};
+	
 	// sort our children
-	std::sort(mChildNodes.begin(), mChildNodes.end(), oDLNode::order);
+	if ((pKeys == NULL) || (pKeys->columnCount() == 0)) {
+		std::sort(mChildNodes.begin(), mChildNodes.end(), oDLNode::order);
+	} else {
+		sDLKeyOrder	keyOrder;
+		keyOrder.mKeys = pKeys;
+		
+		std::stable_sort(mChildNodes.begin(), mChildNodes.end(), keyOrder);
+	};
 	
 	// now tell our children to also sort
 	for (unsigned long index = 0; index < mChildNodes.size(); index++) {
 		oDLNode *child = mChildNodes[index];
 		
-		child->sortChildren();
+		child->sortChildren(pKeys, pCancel);
 	};
 };
 
@@ -315,8 +1025,6 @@ void	oDLNode::unTouchChildren(void) {
 		child->unTouchChildren();
 	};
 	
-	mListLineNo = -1; // reset this
-	
 	// if this is a node created by our grouping, clear our related line and sort
 	if (mValue.length()!=0 || mDescription.length()!=0) {
 		mLineNo		= 0;
@@ -339,3 +1047,126 @@ void	oDLNode::removeUntouched(void) {
 		};
 	};
 };
+
+////////////////////////////////////////////////
+// keys
+////////////////////////////////////////////////
+
+// Key identifying this node amongst its siblings
+oDLKey	oDLNode::nodeKey(void) {
+	oDLKey	key;
+	
+	if (mValue.length()!=0) {
+		key += (qchar) 'V';
+		key += keyFromString(mValue);
+	} else if (mDescription.length()!=0) {
+		key += (qchar) 'D';
+		key += keyFromString(mDescription);
+	} else {
+		// just a line, identify it by its line number
+		key += (qchar) 'L';
+		for (qlong lineNo = mLineNo; lineNo > 0; lineNo = lineNo / 10) {
+			key += (qchar) ('0' + (lineNo % 10));
+		};
+	};
+	
+	return key;
+};
+
+// Convert a string to a key
+oDLKey	oDLNode::keyFromString(const qstring & pString) {
+	return oDLKey(pString.cString(), pString.length());
+};
+
+// Convert a key back to a string
+void	oDLNode::keyToString(const oDLKey & pKey, qstring & pString) {
+	pString = QTEXT("");
+	for (size_t i = 0; i < pKey.length(); i++) {
+		pString += pKey[i];
+	};
+};
+
+// Fold a key so it compares case insensitive
+void	oDLNode::foldKey(oDLKey & pKey) {
+	for (size_t i = 0; i < pKey.length(); i++) {
+		qchar	ch = pKey[i];
+		if ((ch >= 'A') && (ch <= 'Z')) {
+			pKey[i] = ch + ('a' - 'A');
+		} else if ((ch >= 0xC0) && (ch <= 0xDE) && (ch != 0xD7)) {
+			// Latin-1 accented capitals
+			pKey[i] = ch + 0x20;
+		};
+	};
+};
+
+////////////////////////////////////////////////
+// oDLSharedModel
+////////////////////////////////////////////////
+
+oDLSharedModel::oDLSharedModel(void) {
+	mKey.mHash		= 0;
+	mKey.mAdjacency	= false;
+	mRefCount		= 1;
+};
+
+oDLSharedModel::~oDLSharedModel(void) {
+	mRoot.clearChildNodes();
+};
+
+// all our published models by the hash of their key, only accessed from the main thread
+oDLSharedModel::oDLModelRegistry &	oDLSharedModel::registry(void) {
+	static oDLModelRegistry	models;
+	
+	return models;
+};
+
+// find a published model built from the same data with the same settings and retain it, returns NULL if there is none
+oDLSharedModel *	oDLSharedModel::find(const sDLModelKey & pKey) {
+	std::pair<oDLModelRegistry::iterator, oDLModelRegistry::iterator>	range = registry().equal_range(pKey.mHash);
+	
+	for (oDLModelRegistry::iterator it = range.first; it != range.second; it++) {
+		if (it->second->mKey.matches(pKey)) {
+			it->second->mRefCount++;
+			return it->second;
+		};
+	};
+	
+	return NULL;
+};
+
+// publish a model taking over pKey and the nodes of pRoot, returned retained
+oDLSharedModel *	oDLSharedModel::publish(sDLModelKey & pKey, oDLNode & pRoot) {
+	oDLSharedModel *	model = new oDLSharedModel();
+	
+	model->mKey.swap(pKey);
+	model->mRoot.swapChildNodes(pRoot);
+	registry().insert(std::make_pair(model->mKey.mHash, model));
+	
+	return model;
+};
+
+// release our model, it is freed when no data list uses it anymore
+void	oDLSharedModel::release(void) {
+	mRefCount--;
+	if (mRefCount == 0) {
+		std::pair<oDLModelRegistry::iterator, oDLModelRegistry::iterator>	range = registry().equal_range(mKey.mHash);
+		
+		for (oDLModelRegistry::iterator it = range.first; it != range.second; it++) {
+			if (it->second == this) {
+				registry().erase(it);
+				break;
+			};
+		};
+		delete this;
+	};
+};
+
+// the data and settings we were built from
+const sDLModelKey &	oDLSharedModel::key(void) const {
+	return mKey;
+};
+
+// our tree
+oDLNode &	oDLSharedModel::root(void) {
+	return mRoot;
+};
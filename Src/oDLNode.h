@@ -6,6 +6,13 @@
  *  Header for our datalist node object
  *
  *  oDLNode is a support object for building our tree node
+ *  oDLSortKeys holds the keys extracted from our list that we sort our nodes on
+ *  sDLSnapshot and oDLGroupBucket let us group a copy of our list data away from our list (and our main thread)
+ *  oDLRowCache holds the rows Omnis gave us in virtual mode, in pages so we can request and evict them in blocks
+ *  oDLSelection keeps the selection state of our list as a bitset so we can change ranges of lines at once
+ *  oDLPrefixIndex is a sorted index over the display values of a column so we can find lines by prefix
+ *  oDLSharedModel is a tree built from a snapshot that data lists showing the same data with the same settings share
+ *  oDLStateStream reads and writes the compact binary we save the state of a data list in
  *
  *  Bastiaan Olij
  */
@@ -14,6 +21,185 @@
 #define odlnodeh
 
 #include "omnis.xcomp.framework.h"
+#include "oThread.h"
+#include <string>
+#include <algorithm>
+#include <map>
+
+typedef std::basic_string<qchar>	oDLKey;										// compact copy of a value, used for hashing and comparing
+
+typedef struct sDLSortKey {
+	qreal			mNumber;											// numeric value for numbers, booleans and dates
+	qlong			mString;											// index into our string table, -1 if this is a numeric key
+} sDLSortKey;
+
+class oDLSortKeys {
+private:
+	std::vector<qlong>		mColumns;									// list columns we sort on
+	std::vector<bool>		mDescending;								// sort descending on this column?
+	std::vector<sDLSortKey>	mKeys;										// our keys, one entry per column per line
+	std::vector<oDLKey>		mStrings;									// folded strings for our string keys
+	qlong					mRowCount;									// number of lines we extracted keys for
+	
+public:
+	oDLSortKeys(void);
+	
+	unsigned long	columnCount(void) const;							// number of columns we sort on
+	void			setColumns(const qstring & pColumns);				// parse our sort columns, i.e. "3,-2" sorts on column 3 ascending and then column 2 descending
+	void			columnsAsString(qstring & pColumns) const;			// return our sort columns as a string
+	void			clear(void);										// clear our keys
+	void			extract(EXTqlist * pList, qlong pRowCount);			// extract our keys from our list
+	int				compare(qlong pLineA, qlong pLineB) const;			// compare two lines, <0 if A goes first, >0 if B goes first, 0 if equal
+	unsigned long long	fingerprint(void) const;						// 64bit hash over our keys so we can tell if the values we sort on changed
+	bool			matches(const oDLSortKeys & pOther) const;			// do we hold the same keys as pOther?
+	void			swap(oDLSortKeys & pOther);							// swap our keys with pOther
+};
+
+typedef struct sDLSnapshot {
+	unsigned long		mColumns;										// number of columns we took values from
+	std::vector<qlong>	mLines;											// lines that passed our filter
+	std::vector<oDLKey>	mValues;										// our values, mColumns entries per line
+	
+	const oDLKey &		value(qlong pIndex, unsigned long pColumn) const { return mValues[(pIndex * mColumns) + pColumn]; };
+	unsigned long long	fingerprint(void) const;						// 64bit hash over our lines and values so we can tell if our data changed
+	bool				matches(const sDLSnapshot & pOther) const;		// do we hold the same lines and values as pOther?
+	void				swap(sDLSnapshot & pOther);						// swap our lines and values with pOther
+} sDLSnapshot;
+
+typedef struct sDLModelKey {
+	unsigned long long	mHash;											// hash over everything below, only if this matches do we compare the rest
+	bool				mAdjacency;										// built from id/parent id pairs instead of grouped on columns
+	std::vector<qlong>	mColumns;										// columns we built our tree from
+	sDLSnapshot			mSnapshot;										// the data we built our tree from
+	oDLSortKeys			mSortKeys;										// the keys we sorted our tree on
+	
+	bool				matches(const sDLModelKey & pOther) const;		// were we built from the same data with the same settings as pOther?
+	void				swap(sDLModelKey & pOther);						// swap our contents with pOther
+} sDLModelKey;
+
+typedef struct sDLCachePage {
+	std::vector<qstring>	mValues;									// our values, one entry per column per row
+	std::vector<bool>		mLoaded;									// which of our rows Omnis has given us
+} sDLCachePage;
+
+class oDLRowCache {
+private:
+	qlong					mPageSize;									// number of rows in a page
+	unsigned long			mColumns;									// number of columns in a row
+	std::map<qlong, sDLCachePage *>	mPages;								// our pages by page number
+	
+	oDLRowCache(const oDLRowCache & pCopy);								// not copyable, we own our pages
+	oDLRowCache & operator=(const oDLRowCache & pCopy);
+	
+	sDLCachePage *	getPage(qlong pPage);								// get a page, creating it if needed
+	
+public:
+	oDLRowCache(qlong pPageSize = 100);
+	~oDLRowCache(void);
+	
+	qlong			pageSize(void) const;								// number of rows in a page
+	qlong			pageOf(qlong pRow) const;							// page containing this row, rows start at 1
+	unsigned long	columnCount(void) const;							// number of columns in a row
+	void			setColumnCount(unsigned long pColumns);				// set our number of columns, this clears our cache
+	void			clear(void);										// remove all our pages
+	bool			requestPage(qlong pPage);							// returns true if we don't have this page yet and it should be requested, it won't be requested again until it is evicted
+	bool			isLoaded(qlong pRow) const;							// returns true if we have the values for this row
+	const qstring &	value(qlong pRow, unsigned long pColumn) const;		// value for this row, only valid if isLoaded returns true
+	void			setValue(qlong pRow, unsigned long pColumn, const qstring & pValue);	// set the value for this row
+	void			evict(qlong pFirstRow, qlong pLastRow);				// remove pages that fall completely outside of these rows
+};
+
+class oDLSelection {
+private:
+	qlong								mRowCount;						// number of lines in our list
+	std::vector<unsigned long long>		mBits;							// selection state, bit 0 of our first word is line 1
+	std::vector<unsigned long long>		mPushed;						// selection state of the Omnis list when we loaded or last pushed our changes
+	
+public:
+	oDLSelection(void);
+	
+	qlong			rowCount(void) const;								// number of lines in our list
+	void			load(EXTqlist * pList);								// load the selection state from our list
+	qlong			push(EXTqlist * pList);								// update the lines in our list whose selection state we changed, returns the number of lines updated
+	bool			isSelected(qlong pLineNo) const;					// is this line selected?
+	void			select(qlong pLineNo, bool pSelect);				// select or deselect a single line
+	void			selectRange(qlong pFrom, qlong pTo, bool pSelect);	// select or deselect all lines from pFrom up to and including pTo, whole words at a time
+	void			selectAll(bool pSelect);							// select or deselect all lines
+};
+
+typedef struct sDLPrefixEntry {
+	oDLKey				mText;											// folded display value
+	qlong				mLineNo;										// line this value belongs to
+	
+	bool				operator<(const sDLPrefixEntry & pOther) const { return (mText < pOther.mText) || ((mText == pOther.mText) && (mLineNo < pOther.mLineNo)); };
+} sDLPrefixEntry;
+
+struct sDLPrefixCompare {
+	bool			operator()(const oDLKey & pPrefix, const sDLPrefixEntry & pEntry) const { return pEntry.mText.compare(0, pPrefix.length(), pPrefix) > 0; };	// compare our prefix with just the start of an entry, so all entries starting with our prefix match it
+};
+
+class oDLPrefixIndex {
+private:
+	qlong							mColumn;							// column we've indexed, 0 if we're not built
+	qlong							mRowCount;							// number of lines in our list when we were built
+	std::vector<sDLPrefixEntry>		mEntries;							// our entries sorted on text
+	
+public:
+	oDLPrefixIndex(void);
+	
+	bool			isBuiltFor(qlong pColumn, qlong pRowCount) const;	// is our index built for this column and number of lines?
+	void			clear(void);										// clear our index, it will be rebuilt on the next find
+	void			start(qlong pColumn, qlong pRowCount);				// start building our index
+	void			add(const qstring & pText, qlong pLineNo);			// add the display value for a line
+	void			finish(void);										// sort our entries
+	void			findRange(const oDLKey & pPrefix, size_t & pFirst, size_t & pLast) const;	// find the entries starting with this folded prefix, pFirst == pLast if there are none
+	qlong			lineAt(size_t pIndex) const;						// line number of an entry
+};
+
+class oDLStateStream {
+private:
+	std::vector<qbyte>		mData;										// our data
+	size_t					mPos;										// read position
+	bool					mFailed;									// set if we tried to read past the end of our data
+	
+public:
+	oDLStateStream(void);												// start an empty stream for writing
+	oDLStateStream(const qbyte * pData, size_t pLength);				// start a stream for reading pData
+	
+	const std::vector<qbyte> &	data(void) const;						// our data
+	bool			failed(void) const;									// did a read fail?
+	bool			atEnd(void) const;									// have we read all our data?
+	
+	void			putLong(qlong pValue);								// write a 32bit value
+	void			putHash(unsigned long long pValue);					// write a 64bit value
+	void			putString(const qstring & pValue);					// write a string
+	qlong			getLong(void);										// read a 32bit value
+	unsigned long long	getHash(void);									// read a 64bit value
+	void			getString(qstring & pValue);						// read a string
+	
+	static void		hashLong(unsigned long long & pHash, qlong pValue);	// add a value to a 64bit FNV-1a hash, unlike std::hash this is the same between sessions
+	static void		hashString(unsigned long long & pHash, const qstring & pValue);	// add a string to a 64bit FNV-1a hash
+};
+
+class oDLNode;
+
+class oDLGroupBucket {
+private:
+	qlong				mFirstLine;										// first line that falls within this group
+	std::vector<qlong>	mLines;											// lines that end up directly in this group
+	std::map<oDLKey, oDLGroupBucket *>	mChildren;						// our sub groups
+	
+	oDLGroupBucket(const oDLGroupBucket & pCopy);						// not copyable, we own our children
+	oDLGroupBucket & operator=(const oDLGroupBucket & pCopy);
+	
+public:
+	oDLGroupBucket(void);
+	~oDLGroupBucket(void);
+	
+	void				addLine(const oDLKey * pValues, unsigned long pLevels, qlong pLineNo);	// add a line following its group values, empty values skip a level
+	void				merge(oDLGroupBucket & pOther);					// merge the groups of another bucket into ours, pOther must contain later lines
+	void				buildNodes(oDLNode & pParent, oAtomic * pCancel = NULL);	// create nodes for our groups and lines, stops early once pCancel is set
+};
 
 class oDLNode {
 private:
@@ -24,12 +210,6 @@ private:
 	qstring			mValue;												// our value, used to find related records
 	qstring			mDescription;										// our description, only used if mLineNo=0
 	
-	// These are only set after we've drawn our tree so we can see where nodes are
-	qdim			mTop;												// top position 
-	qdim			mBottom;											// bottom position	
-	qrect			mTreeIconRect;										// Rectangle for our tree icon
-	qlong			mListLineNo;										// this is drawn as line number....
-	
 	// nodes
 	std::vector<oDLNode *>	mChildNodes;								// child nodes
 
@@ -49,20 +229,9 @@ public:
 	qlong			sortOrder(void);									// our sort order
 	void			setSortOrder(qlong pSortOrder);						// set our sort order 
 	
-	// for our drawing
-	qlong			listLineNo(void);									// drawn as line no
-	void			setListLineNo(qlong pLineNo);						// set draws as line no
-	qdim			top(void);											// top of our node
-	void			setTop(qdim pTop);									// set the top of our node
-	qdim			bottom(void);										// bottom of our node
-	void			setBottom(qdim pBottom);							// set bottom of our node
-	qrect			treeIconRect(void);									// our tree icon rectangle
-	void			setTreeIconRect(qrect pRect);						// set our tree icon rectangle
-	
 	// read only
 	const qstring &	value(void);										// value
 	const qstring &	description(void);									// description
-	bool			aboveTreeIcon(qpoint pAt);							// is this point within our tree icon?
 	
 	// methods
 	void			clearChildNodes();									// Clear all the child nodes
@@ -71,19 +240,41 @@ public:
 	oDLNode	*		findChildByValue(const qstring & pValue);			// Find a child node by value
 	oDLNode	*		findChildByDescription(const qstring & pDesc, bool pNoValue=false);	// Find a child node by description
 	oDLNode	*		findChildByLineNo(qlong pLineNo, bool pNoValue = false);	// Find a child node by line number
-	oDLNode *		findChildByPoint(qpoint pAt);						// Find a child node by screen location
 	oDLNode *		getChildByIndex(unsigned long pIndex);				// Get child at specific index
-
-	
-	qlong			findListLineNo(qlong pLineNo);						// Get our list line no for a line in our source list
-	qdim			findTopForLine(qlong pLineNo);						// Find top position for specific line (will check child nodes if applicable)
+	void			swapChildNodes(oDLNode & pOther);					// Swap our child nodes with those of another node
+	void			copyExpandedFrom(oDLNode & pOld);					// Copy the expanded state of matching nodes in an older tree
 		
 	static bool		order(oDLNode * pA, oDLNode * pB);					// Static function that returns whether true if the sort order of A is smaller then B
-	void			sortChildren(void);									// Sort our child nodes
+	void			sortChildren(const oDLSortKeys * pKeys = NULL, oAtomic * pCancel = NULL);	// Sort our child nodes, by our sort keys if specified, stops early once pCancel is set
 	void			unTouchChildren(void);								// Marks all children as untouched
 	void			removeUntouched(void);								// Removes children that are untouched	
+	
+	// keys
+	oDLKey			nodeKey(void);										// Key identifying this node amongst its siblings
+	static oDLKey	keyFromString(const qstring & pString);				// Convert a string to a key
+	static void		keyToString(const oDLKey & pKey, qstring & pString);	// Convert a key back to a string
+	static void		foldKey(oDLKey & pKey);								// Fold a key so it compares case insensitive
 };
 
-
+class oDLSharedModel {
+private:
+	sDLModelKey			mKey;											// the data and settings we were built from
+	int					mRefCount;										// number of data lists using us
+	oDLNode				mRoot;											// our tree, this must not change once we're published
+	
+	oDLSharedModel(void);
+	~oDLSharedModel(void);
+	
+	typedef std::multimap<unsigned long long, oDLSharedModel *>	oDLModelRegistry;
+	static oDLModelRegistry &	registry(void);							// all our published models by the hash of their key, only accessed from the main thread
+	
+public:
+	static oDLSharedModel *	find(const sDLModelKey & pKey);				// find a published model built from the same data with the same settings and retain it, returns NULL if there is none
+	static oDLSharedModel *	publish(sDLModelKey & pKey, oDLNode & pRoot);	// publish a model taking over pKey and the nodes of pRoot, returned retained
+	void				release(void);									// release our model, it is freed when no data list uses it anymore
+	
+	const sDLModelKey &	key(void) const;								// the data and settings we were built from
+	oDLNode &			root(void);										// our tree
+};
 
 #endif
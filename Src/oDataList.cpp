@@ -25,6 +25,37 @@ oDataList::oDataList(void) {
 	mShowSelected			= false;
 	mRebuildNodes			= true;
 	mDeselectOnNodeClick	= false;
+	mIdColumn				= 0;
+	mParentIdColumn			= 0;
+	mVirtualRowCount		= 0;
+	mVirtualWindow			= 1000;
+	mVirtualCurrentRow		= 0;
+	mScrollOnlyPaint		= false;
+	mSelectionStale			= true;
+	mPrefetchRows			= 0;
+	mPrefetchPaint			= false;
+	mPainting				= false;
+	mSmoothScroll			= false;
+	mVertScrollOffset		= 0;
+	mContentHeight			= 0;
+	mRowEstimate			= 20;
+	mPaintCacheMisses		= 0;
+	mPaintRows				= 0;
+	mPaintTime				= 0;
+	mStateFingerprint		= 0;
+	mStateRowCount			= 0;
+	mDrawParentIndex		= -1;
+	mNavIndex				= -1;
+	mTypeAheadAt			= 0;
+	mSharedTree				= false;
+	mSharedModel			= NULL;
+	mSharedRowCount			= 0;
+	mAsyncRebuild			= false;
+	mAsyncFingerprint		= 0;
+	mAsyncRowCount			= 0;
+	mOwnPaint				= false;
+	mListLineCount			= 0;
+	mRebuildJob				= NULL;
 	mEvenColor				= GDI_COLOR_QDEFAULT;
 	mSelectColor			= GDI_COLOR_QDEFAULT;
 	mIndent					= 20;
@@ -36,6 +67,10 @@ oDataList::oDataList(void) {
 
 // Destructor to clean up
 oDataList::~oDataList(void) {
+	mIdleTimer.stop();
+	cancelAsyncRebuild();
+	releaseSharedModel();
+	clearPaintColumns();
 	clearGroupCalcs();
 	clearColumnCalcs();
 };
@@ -98,7 +133,10 @@ qdim	oDataList::drawDividers(qdim pTop, qdim pBottom) {
 	qdim	left = 0;
 	for (qulong i = 0; i<mColumnCount; i++) {
 		left += mColumnWidths[i];
-		mCanvas->drawLine(qpoint(left-mHorzScrollPos,mClientRect.top), qpoint(left-mHorzScrollPos,mClientRect.bottom), 1, GDI_COLOR_QGRAY, patStd0); // should make the color and linestyle configurable
+		if ((left-mHorzScrollPos >= mClientRect.left) && (left-mHorzScrollPos <= mClientRect.right)) {
+			// only draw the dividers we can see, but we do need our full width
+			mCanvas->drawLine(qpoint(left-mHorzScrollPos,mClientRect.top), qpoint(left-mHorzScrollPos,mClientRect.bottom), 1, GDI_COLOR_QGRAY, patStd0); // should make the color and linestyle configurable
+		};
 	};
 	
 	return left;
@@ -107,89 +145,68 @@ qdim	oDataList::drawDividers(qdim pTop, qdim pBottom) {
 // Draw this node, might move this into oDLNode one day..
 qdim	oDataList::drawNode(EXTCompInfo* pECI, oDLNode &pNode, qdim pIndent, qdim pTop, qlong & pListLineNo, bool & pIsEven) {
 	qdim	headerHeight = 0;
+	qlong	ourIndex = -1;	// our index in our flattened index, -1 for our root node
+	bool	expanded = isNodeExpanded(&pNode);
 
-	// increase our list line number and write it back into our node
+	// increase our list line number, we keep this in our flattened index as our nodes may be shared with other data lists
 	pListLineNo++;
-	pNode.setListLineNo(pListLineNo);
-	
-	// write top info back into our node..
-	pNode.setTop(pTop);
 	
 	if (pIndent == -1) {
 		// our root node, ignore this...
 		pIndent = 0;
 	} else {
-		bool	needIcon = pNode.childNodeCount()>0;
+		bool			needIcon = pNode.childNodeCount()>0;
+		sDLVisibleNode	entry;
+		
+		// add to our flattened index of visible nodes
+		ourIndex = mVisibleNodes.size();
+		if ((pNode.lineNo() > 0) && (pNode.lineNo() < (qlong) mVisibleIndex.size())) {
+			mVisibleIndex[pNode.lineNo()] = ourIndex;
+		};
+		entry.mNode			= &pNode;
+		entry.mParent		= mDrawParentIndex;
+		entry.mListLineNo	= pListLineNo;
+		entry.mTop			= pTop;
+		entry.mRowBottom	= pTop;
+		entry.mBottom		= pTop;
+		entry.mTreeIconRect.left	= 0;
+		entry.mTreeIconRect.top		= 0;
+		entry.mTreeIconRect.right	= 0;
+		entry.mTreeIconRect.bottom	= 0;
+		entry.mOffset		= mContentHeight;
+		entry.mIndent		= pIndent;
+		entry.mIsEven		= pIsEven;
+		mVisibleNodes.push_back(entry);
 		
 		if ((pListLineNo <= mVertScrollPos) || (pTop > mClientRect.bottom)) {
 			// off screen, no need to draw but we do continue..
-		} else {			
-			if (pNode.lineNo()!=0) {
-				// draw as a full line
-				headerHeight = drawRow(pECI, pNode.lineNo(), pIndent + (needIcon ? mIndent : 0), pTop + 2, pIsEven);
-				headerHeight -= pTop;
-			} else {
-				// Draw our description
-				qrect	columnRect;
-				qdim	colwidth	= 10000; // No longer using mColumnWidths[0], may make this switchable, allow groupings to go along as far as they like..
-				qdim	width		= colwidth - pIndent - (needIcon ? mIndent : 0) - 4;
-				
-				headerHeight = 2 + mCanvas->getTextHeight(pNode.description().cString(), width > 10 ? width : 10, true, true);
-				if (headerHeight > mMaxRowHeight) {
-					headerHeight = mMaxRowHeight;
-				};
-				
-				if (pIsEven && (mEvenColor!=GDI_COLOR_QDEFAULT)) {
-					// draw even color background...
-					qrect	backGroundRect;
-					backGroundRect.left		= mClientRect.left;
-					backGroundRect.top		= pTop - mHorzScrollPos;
-					backGroundRect.right	= mClientRect.right;
-					backGroundRect.bottom	= backGroundRect.top + headerHeight + mLineSpacing;
-					
-					mCanvas->drawRect(backGroundRect, mEvenColor, mEvenColor);
-				};
-				
-				columnRect.left		= pIndent - mHorzScrollPos + (needIcon ? mIndent : 0) + 2;
-				columnRect.top		= pTop + 2;
-				columnRect.right	= colwidth - mHorzScrollPos - 2;
-				columnRect.bottom	= columnRect.top + headerHeight;
-				
-				mCanvas->drawText(pNode.description().cString(), columnRect, mTextColor, jstLeft, true, true);
-			};
-			
-			if (needIcon) {
-				// now draw expanded/collapsed icon
-				qrect treeRect;
-				
-				treeRect.left	= pIndent + 1;
-				treeRect.right	= treeRect.left + mIndent;
-				treeRect.top	= pTop;
-				treeRect.bottom	= treeRect.top + mIndent;
-				
-				pNode.setTreeIconRect(treeRect);
-				
-                qrect at = treeRect;
-                treeRect.left -= mHorzScrollPos;
-				mCanvas->drawIcon((pNode.expanded() ? 1120 : 1121), treeRect);
+			if (mSmoothScroll) {
+				// we still need to know how high we are for our scroll range
+				mContentHeight += estimateNodeHeight(pNode, pIndent + (needIcon ? mIndent : 0));
 			};
-			
+		} else {
+			headerHeight	= drawNodeRow(pECI, ourIndex, pIndent, pTop, pIsEven);
 			headerHeight	+= mLineSpacing;	// add some spacing..
+			mVisibleNodes[ourIndex].mRowBottom = pTop + headerHeight;
+			mContentHeight	+= headerHeight;
 		} 
 		
 		pIndent		+= mIndent;
 		pIsEven		= !pIsEven;			// toggle
 	};
 	
-	if (pNode.expanded()) {
+	if (expanded) {
 		qulong i;
+		qlong	parentIndex = mDrawParentIndex;
 		pTop += headerHeight;
 		
-		// draw child nodes
+		// draw child nodes, we're their parent
+		mDrawParentIndex = ourIndex;
 		for (i = 0; i<pNode.childNodeCount(); i++) {
 			oDLNode *child = pNode.getChildByIndex(i);
 			pTop = drawNode(pECI, *child, pIndent, pTop, pListLineNo, pIsEven);
 		};
+		mDrawParentIndex = parentIndex;
 		
 		// draw totals?
 	} else {
@@ -200,8 +217,10 @@ qdim	oDataList::drawNode(EXTCompInfo* pECI, oDLNode &pNode, qdim pIndent, qdim p
 		pTop += headerHeight;
 	};
 	
-	// write bottom  back into our node..
-	pNode.setBottom(pTop);
+	// write bottom back into our index..
+	if (ourIndex != -1) {
+		mVisibleNodes[ourIndex].mBottom = pTop;
+	};
 
 	if ((pListLineNo > mVertScrollPos) && (pTop <= mClientRect.bottom)) {
 		// only counts if it is fully visible
@@ -211,69 +230,373 @@ qdim	oDataList::drawNode(EXTCompInfo* pECI, oDLNode &pNode, qdim pIndent, qdim p
 	return pTop;
 };
 
-// Draw this line, might move this into oDLNode one day..
-qdim	oDataList::drawRow(EXTCompInfo* pECI, qlong pLineNo, qdim pIndent, qdim pTop, bool pIsEven) {
-	qdim				left			= 0;
-	qdim				lineheight		= mCanvas->getFontHeight(); // minimum line height...
-	qulong				i;
-	qlong				oldCurRow		= mOmnisList->getCurRow();
-	bool				isSelected		= ((mShowSelected && mOmnisList->isRowSelected(pLineNo)) || (!mShowSelected && (pLineNo == oldCurRow)));
-	qArray<qstring *>	columndata;
+// Draw the row of a node in our flattened index, returns its height without spacing
+qdim	oDataList::drawNodeRow(EXTCompInfo* pECI, qlong pIndex, qdim pIndent, qdim pTop, bool pIsEven) {
+	oDLNode &	node = *mVisibleNodes[pIndex].mNode;
+	bool		needIcon = node.childNodeCount()>0;
+	qdim		headerHeight = 0;
 	
-	mOmnisList->setCurRow(pLineNo);
+	if (node.lineNo()!=0) {
+		// draw as a full line
+		headerHeight = drawRow(pECI, node.lineNo(), pIndent + (needIcon ? mIndent : 0), pTop + 2, pIsEven);
+		headerHeight -= pTop;
+	} else {
+		// Draw our description
+		qrect	columnRect;
+		qdim	colwidth	= 10000; // No longer using mColumnWidths[0], may make this switchable, allow groupings to go along as far as they like..
+		qdim	width		= colwidth - pIndent - (needIcon ? mIndent : 0) - 4;
+		
+		headerHeight = 2 + mCanvas->getTextHeight(node.description().cString(), width > 10 ? width : 10, true, true);
+		if (headerHeight > mMaxRowHeight) {
+			headerHeight = mMaxRowHeight;
+		};
+		
+		if (pIsEven && (mEvenColor!=GDI_COLOR_QDEFAULT)) {
+			// draw even color background...
+			qrect	backGroundRect;
+			backGroundRect.left		= mClientRect.left;
+			backGroundRect.top		= pTop - mHorzScrollPos;
+			backGroundRect.right	= mClientRect.right;
+			backGroundRect.bottom	= backGroundRect.top + headerHeight + mLineSpacing;
+			
+			mCanvas->drawRect(backGroundRect, mEvenColor, mEvenColor);
+		};
+		
+		columnRect.left		= pIndent - mHorzScrollPos + (needIcon ? mIndent : 0) + 2;
+		columnRect.top		= pTop + 2;
+		columnRect.right	= colwidth - mHorzScrollPos - 2;
+		columnRect.bottom	= columnRect.top + headerHeight;
+		
+		mCanvas->drawText(node.description().cString(), columnRect, mTextColor, jstLeft, true, true);
+	};
 	
-	// !BAS! This is now no longer called unless the line is visible.
-	// We should be able to optimise this code by storing the wrapped text in columndata and save us some overhead.
+	if (needIcon) {
+		// now draw expanded/collapsed icon
+		qrect treeRect;
+		
+		treeRect.left	= pIndent + 1;
+		treeRect.right	= treeRect.left + mIndent;
+		treeRect.top	= pTop;
+		treeRect.bottom	= treeRect.top + mIndent;
+		
+		mVisibleNodes[pIndex].mTreeIconRect = treeRect;
+		
+		treeRect.left -= mHorzScrollPos;
+		mCanvas->drawIcon((isNodeExpanded(&node) ? 1120 : 1121), treeRect);
+	};
+	
+	return headerHeight;
+};
 
-	// 1) find the line height of each text to find the highest line
-	for (i = 0; i < mColumnCount; i++) {
-		qstring 		calcstr;
-		qstring *		newdata;
-		
-		if (mColumnPrefix.length()!=0) {
-			if (mColumnCalculations[i]->length()==0) {
-				EXTfldval	dataNameFld;
-				ECOgetProperty(mHWnd, anumFieldname, dataNameFld);
-				qstring		dataStr(dataNameFld);
-				
-				calcstr.appendFormattedString("con(%qs,%qs.%li)",&mColumnPrefix, &dataStr, i);
-			} else {
-				calcstr.appendFormattedString("con(%qs,%qs)",&mColumnPrefix, mColumnCalculations[i]);
+// Draw the rows we drew during our last paint again from our flattened index, without walking our tree
+// This is only valid as long as our nodes, our list and our scroll position haven't changed since
+void	oDataList::redrawVisibleNodes(EXTCompInfo* pECI) {
+	for (qlong index = firstVisibleIndex(); index < (qlong) mVisibleNodes.size(); index++) {
+		const sDLVisibleNode &	entry = mVisibleNodes[index];
+		
+		if (entry.mTop > mClientRect.bottom) {
+			// we're past the bottom
+			break;
+		} else if (entry.mRowBottom != entry.mTop) {
+			// we drew this row last time
+			drawNodeRow(pECI, index, entry.mIndent, entry.mTop, entry.mIsEven);
+		};
+	};
+};
+
+// Get the text for a column of a line in a list, our list doesn't have to be our own list
+void	oDataList::getColumnText(EXTCompInfo* pECI, EXTqlist * pList, qlong pLineNo, qulong pColumn, qstring & pText) {
+	sDLPaintColumn	column;
+	
+	if (mPainting && (pColumn < mPaintColumns.size()) && mPaintColumns[pColumn].mChecked) {
+		// we've already compiled this during this paint
+		column = mPaintColumns[pColumn];
+	} else {
+		compileColumn(pECI, pColumn, column);
+		
+		if (mPainting) {
+			// keep it until we're done painting
+			if (mPaintColumns.size() < mColumnCount) {
+				sDLPaintColumn	unchecked = { false, false, NULL };
+				mPaintColumns.resize(mColumnCount, unchecked);
+				mPaintCacheMisses++;
 			};
+			mPaintColumns[pColumn] = column;
+			if (column.mCalc != NULL) {
+				mPaintCacheMisses++;
+			};
+		};
+	};
+	
+	evalColumn(pECI, pList, pLineNo, pColumn, column, pText);
+	
+	if (!mPainting && (column.mCalc != NULL)) {
+		delete column.mCalc;
+	};
+};
+
+// Compile the calculation for a column, the caller frees pCompiled.mCalc
+void	oDataList::compileColumn(EXTCompInfo* pECI, qulong pColumn, sDLPaintColumn & pCompiled) {
+	qstring 		calcstr;
+	
+	if (mColumnPrefix.length()!=0) {
+		if (mColumnCalculations[pColumn]->length()==0) {
+			EXTfldval	dataNameFld;
+			ECOgetProperty(mHWnd, anumFieldname, dataNameFld);
+			qstring		dataStr(dataNameFld);
+			
+			calcstr.appendFormattedString("con(%qs,%qs.%li)",&mColumnPrefix, &dataStr, pColumn);
 		} else {
-			calcstr = *mColumnCalculations[i];
+			calcstr.appendFormattedString("con(%qs,%qs)",&mColumnPrefix, mColumnCalculations[pColumn]);
+		};
+	} else {
+		calcstr = *mColumnCalculations[pColumn];
+	};
+	
+	// addToTraceLog(calcstr);
+	
+	pCompiled.mChecked	= true;
+	pCompiled.mDirect	= calcstr.length()==0;
+	pCompiled.mCalc		= pCompiled.mDirect ? NULL : newCalculation(calcstr, pECI);
+};
+
+// Get the text for a column of a line with a compiled column
+void	oDataList::evalColumn(EXTCompInfo* pECI, EXTqlist * pList, qlong pLineNo, qulong pColumn, const sDLPaintColumn & pCompiled, qstring & pText) {
+	if (pCompiled.mDirect) {
+		EXTfldval colFld;
+		
+		// just get the column...
+		pList->getColValRef(pLineNo, pColumn+1, colFld, qfalse);
+		pText = qstring(colFld);
+	} else if (pCompiled.mCalc == NULL) {
+		pText = QTEXT("???");
+	} else {
+		EXTfldval	result;
+		pCompiled.mCalc->evalCalculation(result, pECI->mLocLocp, pList, qfalse);
+		pText = qstring(result);
+	};
+};
+
+// Free the calculations we compiled during our paint, we keep our array so our next paint doesn't need to allocate it again
+void	oDataList::clearPaintColumns(void) {
+	for (qulong i = 0; i < mPaintColumns.size(); i++) {
+		if (mPaintColumns[i].mCalc != NULL) {
+			delete mPaintColumns[i].mCalc;
+		};
+		mPaintColumns[i].mChecked	= false;
+		mPaintColumns[i].mDirect	= false;
+		mPaintColumns[i].mCalc		= NULL;
+	};
+};
+
+// Find the columns that are visible after horizontal scrolling, if none are pFirst will be our column count
+void	oDataList::getVisibleColumns(qulong & pFirst, qulong & pLast) {
+	qdim	left = -mHorzScrollPos;
+	
+	pFirst	= mColumnCount;
+	pLast	= 0;
+	for (qulong i = 0; i < mColumnCount; i++) {
+		qdim	right = left + mColumnWidths[i];
+		
+		if ((right > mClientRect.left) && (left < mClientRect.right)) {
+			if (pFirst == mColumnCount) {
+				pFirst = i;
+			};
+			pLast = i;
+		};
+		
+		left = right;
+	};
+};
+
+// Width we wrap the text of a column in
+qdim	oDataList::getColumnTextWidth(qulong pColumn, qdim pIndent) {
+	qdim width = mColumnWidths[pColumn] - 4 - (pColumn==0 ? pIndent : 0);
+	
+	return width > 10 ? width : 10;
+};
+
+// Get the height we measured before for the text in this column, returns false if we haven't got it
+bool	oDataList::getCachedColumnHeight(qlong pLineNo, qulong pColumn, qdim pWidth, qdim & pHeight) {
+	std::map<unsigned long long, sDLCellHeight>::iterator	it = mCellHeights.find(cellHeightKey(pLineNo, pColumn));
+	
+	if ((it == mCellHeights.end()) || (it->second.mWidth != pWidth)) {
+		// never measured or our column was resized
+		return false;
+	};
+	
+	pHeight = it->second.mHeight;
+	return true;
+};
+
+// Get the text for a column of a line in our list, evaluating it only if we haven't before, mOmnisList must be on this line
+const qstring &	oDataList::getCachedColumnText(EXTCompInfo* pECI, qlong pLineNo, qulong pColumn) {
+	unsigned long long	key = cellHeightKey(pLineNo, pColumn);
+	std::map<unsigned long long, qstring>::iterator	it = mCellTexts.find(key);
+	
+	if (it == mCellTexts.end()) {
+		// references to our entries stay valid until we clear our cache, so we can draw straight from it
+		qstring &	text = mCellTexts[key];
+		
+		getColumnText(pECI, mOmnisList, pLineNo, pColumn, text);
+		mPaintCacheMisses++;
+		return text;
+	};
+	
+	return it->second;
+};
+
+// Queue the rows around our visible rows for prefetching, the rows below our visible rows go first as that is where the user is most likely to scroll to
+void	oDataList::queuePrefetch(void) {
+	qlong	count = mVisibleNodes.size();
+	
+	mPrefetchLines.clear();
+	if ((mPrefetchRows <= 0) || (count == 0)) {
+		return;
+	};
+	
+	// find our first and last visible node
+	qlong	first = firstVisibleIndex();
+	qlong	last = first;
+	while ((last + 1 < count) && (mVisibleNodes[last + 1].mListLineNo <= mLastVisListNo)) {
+		last++;
+	};
+	
+	// we take our lines from the back, so we queue the rows above us from the top down, then the rows below us from the bottom up
+	qlong	from = first - mPrefetchRows > 0 ? first - mPrefetchRows : 0;
+	qlong	to = last + mPrefetchRows < count - 1 ? last + mPrefetchRows : count - 1;
+	qlong	above = first - from;
+	qlong	below = to > last ? to - last : 0;
+	for (qlong i = 0; i < above + below; i++) {
+		const sDLVisibleNode &	entry = mVisibleNodes[i < above ? from + i : to - (i - above)];
+		sDLPrefetchLine			line;
+		
+		if (entry.mNode->lineNo() <= 0) {
+			// just a group, we don't cache these
+			continue;
+		};
+		
+		// same indent drawNode gives this line
+		line.mLineNo	= entry.mNode->lineNo();
+		line.mIndent	= entry.mNode->childNodeCount() > 0 ? mIndent : 0;
+		for (qlong parent = entry.mParent; parent != -1; parent = mVisibleNodes[parent].mParent) {
+			line.mIndent += mIndent;
 		};
 		
-		// addToTraceLog(calcstr);
+		mPrefetchLines.push_back(line);
+	};
+};
+
+// Evaluate and measure queued rows for a short while, returns true if there are rows left. mOmnisList must be set and we must be drawing
+bool	oDataList::prefetchRows(EXTCompInfo* pECI) {
+	qulong		started = oThread::milliseconds();	// don't keep the user waiting if they start doing something, clock() is CPU time so we use a wall clock
+	qlong		oldCurRow = mOmnisList->getCurRow();
+	qlong		rowCount = mOmnisList->rowCnt();
+	qulong		firstColumn, lastColumn;
+	
+	getVisibleColumns(firstColumn, lastColumn);
+	
+	while ((mPrefetchLines.size() > 0) && (oThread::milliseconds() - started < 10)) {
+		sDLPrefetchLine	line = mPrefetchLines.back();
+		mPrefetchLines.pop_back();
+		
+		if (line.mLineNo > rowCount) {
+			continue;
+		};
+		
+		mOmnisList->setCurRow(line.mLineNo);
 		
-		if (calcstr.length()==0) {
-			EXTfldval colFld;
+		// same columns drawRow needs, so our next scroll finds them ready
+		for (qulong i = 0; i < mColumnCount; i++) {
+			bool	visible = (i >= firstColumn) && (i <= lastColumn);
+			bool	extend = (i < 256) && mColumnExtend[i];
 			
-			// just get the column...
-			mOmnisList->getColValRef(pLineNo, i+1, colFld, qfalse);
-			newdata = new qstring(colFld);
-		} else {
-			// should fine a relyable way to cache our calculations....
-			// also should move this code into something more central
-			EXTfldval	* calcFld = newCalculation(calcstr, pECI);			
-			if (calcFld == NULL) {
-				newdata = new qstring();
-				*newdata += QTEXT("???");
-			} else {
-				EXTfldval	result;
-				calcFld->evalCalculation(result, pECI->mLocLocp, mOmnisList, qfalse);
-				newdata = new qstring(result);
+			if (!visible && !extend) {
+				continue;
+			};
+			
+			const qstring &	text = getCachedColumnText(pECI, line.mLineNo, i);
+			
+			if (extend) {
+				qdim	width = getColumnTextWidth(i, line.mIndent);
+				qdim	height;
 				
-				delete calcFld;
-			};			
+				if (!getCachedColumnHeight(line.mLineNo, i, width, height)) {
+					sDLCellHeight &	cell = mCellHeights[cellHeightKey(line.mLineNo, i)];
+					cell.mWidth		= width;
+					cell.mHeight	= mCanvas->getTextHeight(text.cString(), width, true, true);
+					mPaintCacheMisses++;
+				};
+			};
 		};
-				
-		columndata.push(newdata);
+	};
+	
+	mOmnisList->setCurRow(oldCurRow);
+	
+	return mPrefetchLines.size() > 0;
+};
+
+// Draw this line, might move this into oDLNode one day..
+qdim	oDataList::drawRow(EXTCompInfo* pECI, qlong pLineNo, qdim pIndent, qdim pTop, bool pIsEven) {
+	qlong				oldCurRow		= mOmnisList->getCurRow();
+	bool				isSelected		= ((mShowSelected && mSelection.isSelected(pLineNo)) || (!mShowSelected && (pLineNo == oldCurRow)));
+	qulong				firstColumn, lastColumn;
+	
+	getVisibleColumns(firstColumn, lastColumn);
+	mOmnisList->setCurRow(pLineNo);
+	mPaintRows++;
+	
+	// reuse our scratch buffer, it only needs to grow if our column count grows
+	if (mRowTexts.capacity() < mColumnCount) {
+		mPaintCacheMisses++;
+	};
+	mRowTexts.assign(mColumnCount, NULL);
+	
+	// !BAS! This is now no longer called unless the line is visible.
+	// We only evaluate the columns we can see, and columns that extend our row height which we haven't measured yet
+	for (qulong i = 0; i < mColumnCount; i++) {
+		bool	visible = (i >= firstColumn) && (i <= lastColumn);
+		qdim	height;
+		
+		if (visible || ((i < 256) && mColumnExtend[i] && !getCachedColumnHeight(pLineNo, i, getColumnTextWidth(i, pIndent), height))) {
+			mRowTexts[i] = &getCachedColumnText(pECI, pLineNo, i);
+		};
+	};
+	
+	mOmnisList->setCurRow(oldCurRow);
+	
+	return drawRowData(pLineNo, mRowTexts, pIndent, pTop, isSelected, pIsEven);
+};
 
-		qdim width = mColumnWidths[i] - 4 - (i==0 ? pIndent : 0);
-		qdim columnHeight = mCanvas->getTextHeight(newdata->cString(), width > 10 ? width : 10, true, true);
-		if (columnHeight>lineheight && (i < 256 ? mColumnExtend[i] : false)) {				
-			lineheight = columnHeight;
+// Draw a line with the text for each column, columns we don't have text for are NULL and are either off screen or not loaded yet
+qdim	oDataList::drawRowData(qlong pLineNo, const std::vector<const qstring *> & pColumnData, qdim pIndent, qdim pTop, bool pIsSelected, bool pIsEven) {
+	qdim				left			= 0;
+	qdim				lineheight		= mCanvas->getFontHeight(); // minimum line height...
+	qulong				i;
+	qulong				firstColumn, lastColumn;
+	
+	getVisibleColumns(firstColumn, lastColumn);
+	
+	// 1) find the line height of each text that extends our row to find the highest line, off screen columns use the height we measured before
+	for (i = 0; (i < mColumnCount) && (i < 256); i++) {
+		if (mColumnExtend[i]) {
+			qdim	width = getColumnTextWidth(i, pIndent);
+			qdim	columnHeight = 0;
+			
+			if (getCachedColumnHeight(pLineNo, i, width, columnHeight)) {
+				// measured before
+			} else if (pColumnData[i] != NULL) {
+				columnHeight = mCanvas->getTextHeight(pColumnData[i]->cString(), width, true, true);
+				
+				sDLCellHeight &	cell = mCellHeights[cellHeightKey(pLineNo, i)];
+				cell.mWidth		= width;
+				cell.mHeight	= columnHeight;
+				mPaintCacheMisses++;
+			};
+			
+			if (columnHeight>lineheight) {				
+				lineheight = columnHeight;
+			};
 		};
 	};
 	
@@ -289,7 +612,7 @@ qdim	oDataList::drawRow(EXTCompInfo* pECI, qlong pLineNo, qdim pIndent, qdim pTo
 	rowRect.top = pTop;
 	rowRect.right = mClientRect.right;
 	rowRect.bottom = pTop + lineheight + mLineSpacing;
-	if (isSelected) {
+	if (pIsSelected) {
 		if (mSelectColor == GDI_COLOR_QDEFAULT) {
 			GDIhiliteTextStart(mCanvas->hdc(), &rowRect, mTextColor);	// !BAS! Move into canvas!
 		} else {
@@ -302,8 +625,13 @@ qdim	oDataList::drawRow(EXTCompInfo* pECI, qlong pLineNo, qdim pIndent, qdim pTo
 	// 3) draw our text
 	left = -mHorzScrollPos;
 	for (i = 0; i < mColumnCount; i++) {
-		qstring *	data = columndata[i];
 		qrect		columnRect;
+		
+		if ((i < firstColumn) || (i > lastColumn)) {
+			// off screen
+			left += mColumnWidths[i];
+			continue;
+		};
 			
 		if (i==0) {
 			columnRect.left	= left + pIndent + 2;
@@ -314,28 +642,1089 @@ qdim	oDataList::drawRow(EXTCompInfo* pECI, qlong pLineNo, qdim pIndent, qdim pTo
 		columnRect.top		= pTop;
 		columnRect.bottom	= pTop + lineheight;
 			
-		mCanvas->drawText(data->cString(), columnRect, mTextColor, mColumnAligns[i], true, true);
+		if (pColumnData[i] != NULL) {
+			mCanvas->drawText(pColumnData[i]->cString(), columnRect, mTextColor, mColumnAligns[i], true, true);
+		};
 			
 		left += mColumnWidths[i];
 	};
 		
-	if (isSelected && (mSelectColor == GDI_COLOR_QDEFAULT)) {
-		// 4) unhighlight
-		GDIhiliteTextEnd(mCanvas->hdc(), &rowRect, mTextColor);	// !BAS! Move into canvas!
+	if (pIsSelected && (mSelectColor == GDI_COLOR_QDEFAULT)) {
+		// 4) unhighlight
+		GDIhiliteTextEnd(mCanvas->hdc(), &rowRect, mTextColor);	// !BAS! Move into canvas!
+	};
+	
+	return pTop + lineheight;
+};
+
+// Draw the rows visible in virtual mode from our row cache, pages we don't have are added to pNeedPages
+void	oDataList::drawVirtualRows(std::vector<qlong> & pNeedPages) {
+	qlong					firstRow	= mVertScrollPos + 1;
+	qlong					row			= firstRow;
+	qdim					top			= 0;
+	bool					isEven		= (firstRow % 2) == 0;	// keep our stripes stable while scrolling
+	
+	if (mRowTexts.capacity() < mColumnCount) {
+		mPaintCacheMisses++;
+	};
+	mRowTexts.assign(mColumnCount, NULL);
+	
+	if (mRowCache.columnCount() != mColumnCount) {
+		// our columns changed, our cached values are no longer valid
+		mRowCache.setColumnCount(mColumnCount);
+	};
+	
+	mLastVisListNo = 0;
+	mVirtualRowBottoms.clear();
+	for (; (row <= mVirtualRowCount) && (top <= mClientRect.bottom); row++) {
+		bool	loaded = mRowCache.isLoaded(row);
+		
+		if (!loaded) {
+			qlong	page = mRowCache.pageOf(row);
+			if (mRowCache.requestPage(page)) {
+				pNeedPages.push_back(page);
+			};
+		};
+		
+		for (qulong i = 0; i < mColumnCount; i++) {
+			mRowTexts[i] = loaded ? &mRowCache.value(row, i) : NULL;
+		};
+		
+		top = drawRowData(row, mRowTexts, 0, top + 2, row == mVirtualCurrentRow, isEven) + mLineSpacing;
+		mPaintRows++;
+		mVirtualRowBottoms.push_back(top);
+		
+		if (top <= mClientRect.bottom) {
+			// only counts if it is fully visible
+			mLastVisListNo = row;
+		};
+		
+		isEven = !isEven;
+	};
+	
+	// only keep the rows within our window around what we've drawn
+	mRowCache.evict(firstRow - mVirtualWindow, row + mVirtualWindow);
+};
+
+// Copy rows Omnis gave us into our row cache
+void	oDataList::setVirtualRows(EXTCompInfo* pECI, qlong pFrom, EXTqlist * pList) {
+	qlong	rowCount = pList->rowCnt();
+	qlong	oldCurRow = pList->getCurRow();
+	
+	if (mRowCache.columnCount() != mColumnCount) {
+		mRowCache.setColumnCount(mColumnCount);
+	};
+	
+	// compile our columns once for all rows, we're not painting so getColumnText would compile them for each row
+	std::vector<sDLPaintColumn>	columns(mColumnCount);
+	for (qulong i = 0; i < mColumnCount; i++) {
+		compileColumn(pECI, i, columns[i]);
+	};
+	
+	for (qlong line = 1; line <= rowCount; line++) {
+		qlong	row = pFrom + line - 1;
+		if ((row < 1) || (row > mVirtualRowCount)) {
+			continue;
+		};
+		
+		pList->setCurRow(line);
+		for (qulong i = 0; i < mColumnCount; i++) {
+			qstring	text;
+			evalColumn(pECI, pList, line, i, columns[i], text);
+			mRowCache.setValue(row, i, text);
+		};
+	};
+	
+	for (qulong i = 0; i < mColumnCount; i++) {
+		if (columns[i].mCalc != NULL) {
+			delete columns[i].mCalc;
+		};
+	};
+	
+	pList->setCurRow(oldCurRow);
+};
+
+
+// Rebuild our nodes using our group calculations
+void	oDataList::buildGroupedNodes(EXTCompInfo* pECI, qlong pRowCount) {
+	mRootNode.unTouchChildren(); // untouch children
+	
+	if (pRowCount!=0) {
+		// !BAS! need to investigate if we can cache these calculations and reuse them....
+		
+		// setup our filter calculation
+		EXTfldval *		filtercalc = NULL;
+		if (mFilter.length() > 0) {
+			filtercalc = newCalculation(mFilter, pECI);
+		};
+		
+		// setup our grouping calculations
+		EXTfldvalArray	groupcalcs;
+		EXTfldvalArray	parentcalcs;
+		unsigned int	group;					
+		
+		// loop through our list
+		for (group = 0; group < mGroupCalculations.size(); group++) {
+			sDLGrouping	grouping	= mGroupCalculations[group];
+			EXTfldval *	calcFld		= newCalculation(*grouping.mGroupCalc, pECI);
+			
+			if (calcFld != NULL) {
+				groupcalcs.push_back(calcFld);
+				
+				// also our parent calculation..
+				EXTfldval * parentFld = NULL;
+				if (grouping.mParentCalc != NULL) {
+					parentFld = newCalculation(*grouping.mParentCalc, pECI);
+				};
+				parentcalcs.push_back(parentFld); // always add even if NULL
+			};
+		};
+		
+		
+		for (qlong lineno = 1; lineno <= pRowCount; lineno++) {
+			bool		showNode = true;
+			oDLNode *	node = &mRootNode;
+			
+			mOmnisList->setCurRow(lineno);
+			
+			if (filtercalc != NULL) {
+				EXTfldval	result;
+				filtercalc->evalCalculation(result, pECI->mLocLocp, mOmnisList, qfalse);
+				if (result.getBool() != 2) {
+					showNode = false;
+				};
+			};
+			
+			if (showNode) {
+				bool	addFinalNode = true;
+				
+				// check our grouping
+				group = 0;
+				while(addFinalNode && (group < groupcalcs.size())) {
+					EXTfldval * calcFld = groupcalcs[group];
+					EXTfldval	result;
+					
+					calcFld->evalCalculation(result, pECI->mLocLocp, mOmnisList, qfalse);
+					qstring		groupdesc(result), value;
+					
+					if (groupdesc.length()>0) {
+						oDLNode *childnode;
+						
+						// we split our description by |. This will allow us to optionally include a unique identifier
+						qlong	pos = groupdesc.pos('|');
+						if (pos > 0) {
+							value		= groupdesc.mid(0,pos);
+							groupdesc	= groupdesc.mid(pos+1);
+							childnode	= node->findChildByValue(value);
+						} else {
+							value		= "";
+							if (pos == 0) {
+								groupdesc	= groupdesc.mid(pos+1);
+							};
+							childnode	= node->findChildByDescription(groupdesc, true);
+						};
+						
+						if (childnode == NULL) {
+							childnode = new oDLNode(value, groupdesc, 0);
+							node->addNode(childnode);
+						} else {
+							childnode->setTouched(true);
+						};
+						
+						if (childnode->sortOrder()==0) {
+							// set the sort order to the first line related to our node
+							childnode->setSortOrder(lineno);
+						};
+						
+						EXTfldval * parentFld = parentcalcs[group];
+						if (parentFld != NULL) {
+							EXTfldval	isParent;
+							parentFld->evalCalculation(isParent, pECI->mLocLocp, mOmnisList, qfalse);
+							
+							if (isParent.getBool()==2) {
+								childnode->setLineNo(lineno);
+								addFinalNode = false; // we've already found it
+							};
+						};
+															
+						node = childnode;									
+					};
+					
+					group++;
+				};
+				
+				if (addFinalNode) {
+					// now add our final node, if this is a self reference node it would already have been added
+					oDLNode * finalNode = node->findChildByLineNo(lineno);
+					if (finalNode!=NULL) {
+						finalNode->setTouched(true);
+					} else {
+						finalNode = new oDLNode(qstring(""), qstring(""), lineno);
+						finalNode->setSortOrder(lineno);
+						node->addNode(finalNode);									
+					};
+				};
+			};
+		};					
+		
+		// cleanup our EXTFlds
+		while (parentcalcs.size()) {
+			EXTfldval *	calcFld = parentcalcs.back();
+			parentcalcs.pop_back();
+			
+			if (calcFld != NULL) {
+				delete calcFld;							
+			};
+		};
+		while (groupcalcs.size()) {
+			EXTfldval *	calcFld = groupcalcs.back();
+			groupcalcs.pop_back();
+			
+			delete calcFld;
+		};
+		if (filtercalc != NULL) {
+			delete filtercalc;
+		};
+		
+		// check if our hittest info is still valid
+		if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row)) {
+			oDLNode *	childnode = mMouseHitTest.mNode;
+			
+			if (childnode->touched() == false) {
+				// this node was not touched and will be removed, our hittest data is no longer valid
+				clearHitTest();						
+			} else if (mMouseHitTest.mLineNo != 0) {
+				if (childnode->lineNo()!=mMouseHitTest.mLineNo) {
+					clearHitTest();														
+				};
+			};
+		};
+		
+		// remove untouched children
+		mRootNode.removeUntouched();
+	} else {
+		if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row)) {
+			// we're about to remove all nodes so this can't be valid anymore
+			clearHitTest();						
+		};
+
+		clearVisibleIndex();
+		mRootNode.clearChildNodes();
+	};
+};
+
+// Take a snapshot of the lines that pass our filter and the values in the given columns
+void	oDataList::takeSnapshot(EXTCompInfo* pECI, qlong pRowCount, const std::vector<qlong> & pColumns, sDLSnapshot & pSnapshot) {
+	qlong			colCount = mOmnisList->colCnt();
+	unsigned long	columns = pColumns.size();
+	
+	pSnapshot.mColumns = columns;
+	pSnapshot.mLines.clear();
+	pSnapshot.mValues.clear();
+	
+	for (unsigned long c = 0; c < columns; c++) {
+		if (pColumns[c] > colCount) {
+			// can't snapshot a column we don't have
+			return;
+		};
+	};
+	
+	// setup our filter calculation
+	EXTfldval *		filtercalc = NULL;
+	if (mFilter.length() > 0) {
+		filtercalc = newCalculation(mFilter, pECI);
+	};
+	
+	pSnapshot.mLines.reserve(pRowCount);
+	pSnapshot.mValues.reserve(pRowCount * columns);
+	
+	// one pass through our list to collect our values, this is the only part that needs our list
+	for (qlong lineno = 1; lineno <= pRowCount; lineno++) {
+		if (filtercalc != NULL) {
+			EXTfldval	result;
+			
+			mOmnisList->setCurRow(lineno);
+			filtercalc->evalCalculation(result, pECI->mLocLocp, mOmnisList, qfalse);
+			if (result.getBool() != 2) {
+				continue;
+			};
+		};
+		
+		pSnapshot.mLines.push_back(lineno);
+		for (unsigned long c = 0; c < columns; c++) {
+			EXTfldval	colFld;
+			
+			mOmnisList->getColValRef(lineno, pColumns[c], colFld, qfalse);
+			pSnapshot.mValues.push_back(oDLNode::keyFromString(qstring(colFld)));
+		};
+	};
+	
+	if (filtercalc != NULL) {
+		delete filtercalc;
+	};
+};
+
+// Swap in a newly built tree, carrying over the expanded state of our current nodes
+void	oDataList::swapInNodes(oDLNode & pNewRoot) {
+	pNewRoot.copyExpandedFrom(mRootNode);
+	
+	if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row) || (mMouseHitTest.mAbove==oDL_treeIcon)) {
+		// we're about to replace all nodes so this can't be valid anymore
+		clearHitTest();
+	};
+	
+	// our old nodes get freed up when pNewRoot goes out of scope
+	mRootNode.swapChildNodes(pNewRoot);
+};
+
+// Clear our flattened index of visible nodes, needed whenever our nodes are freed
+void	oDataList::clearVisibleIndex(void) {
+	mVisibleNodes.clear();
+	mVisibleIndex.clear();
+};
+
+// The tree we're showing, either our own or the one we share with other data lists
+oDLNode &	oDataList::rootNode(void) {
+	return mSharedModel != NULL ? mSharedModel->root() : mRootNode;
+};
+
+// Is this node expanded? Shared nodes are expanded unless we collapsed them, other data lists may show them differently
+bool	oDataList::isNodeExpanded(oDLNode * pNode) {
+	if (mSharedModel != NULL) {
+		return mCollapsedNodes.find(pNode) == mCollapsedNodes.end();
+	};
+	
+	return pNode->expanded();
+};
+
+// Expand or collapse this node
+void	oDataList::setNodeExpanded(oDLNode * pNode, bool pExpanded) {
+	if (mSharedModel == NULL) {
+		pNode->setExpanded(pExpanded);
+	} else if (pExpanded) {
+		mCollapsedNodes.erase(pNode);
+	} else {
+		mCollapsedNodes.insert(pNode);
+	};
+};
+
+// Find the nodes in pNew matching collapsed nodes in pOld
+void	oDataList::carryCollapsed(oDLNode & pOld, oDLNode & pNew, std::set<const oDLNode *> & pCollapsed) {
+	if ((pOld.childNodeCount() == 0) || (pNew.childNodeCount() == 0)) {
+		// nothing to match
+		return;
+	};
+	
+	// index the old children once so matching is linear
+	std::map<oDLKey, oDLNode *>	oldNodes;
+	for (unsigned long index = 0; index < pOld.childNodeCount(); index++) {
+		oDLNode *child = pOld.getChildByIndex(index);
+		oldNodes.insert(std::make_pair(child->nodeKey(), child));
+	};
+	
+	for (unsigned long index = 0; index < pNew.childNodeCount(); index++) {
+		oDLNode *child = pNew.getChildByIndex(index);
+		std::map<oDLKey, oDLNode *>::iterator found = oldNodes.find(child->nodeKey());
+		
+		if (found != oldNodes.end()) {
+			if (!isNodeExpanded(found->second)) {
+				pCollapsed.insert(child);
+			};
+			carryCollapsed(*found->second, *child, pCollapsed);
+		};
+	};
+};
+
+// Stop using a shared tree, we'll build our own on our next rebuild
+void	oDataList::releaseSharedModel(void) {
+	if (mSharedModel != NULL) {
+		if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row) || (mMouseHitTest.mAbove==oDL_treeIcon)) {
+			// these nodes may be freed
+			clearHitTest();
+		};
+		clearVisibleIndex();
+		
+		mSharedModel->release();
+		mSharedModel = NULL;
+		mCollapsedNodes.clear();
+		mRebuildNodes = true;
+	};
+};
+
+// Build or find a tree from a snapshot of our list that we share with other data lists showing the same data with the same settings
+void	oDataList::buildSharedNodes(EXTCompInfo* pECI, qlong pRowCount) {
+	sDLModelKey			key;
+	bool				adjacency = (mIdColumn > 0) && (mParentIdColumn > 0);
+	
+	key.mAdjacency = adjacency;
+	if (adjacency) {
+		key.mColumns.push_back(mIdColumn);
+		key.mColumns.push_back(mParentIdColumn);
+	} else {
+		key.mColumns = mGroupColumns;
+	};
+	takeSnapshot(pECI, pRowCount, key.mColumns, key.mSnapshot);
+	
+	// our key covers our data (after filtering) and everything that changes how we build and sort our tree
+	key.mHash = key.mSnapshot.fingerprint();
+	oDLStateStream::hashLong(key.mHash, adjacency ? 1 : 0);
+	oDLStateStream::hashLong(key.mHash, key.mColumns.size());
+	for (unsigned long i = 0; i < key.mColumns.size(); i++) {
+		oDLStateStream::hashLong(key.mHash, key.mColumns[i]);
+	};
+	if (mSortKeys.columnCount() > 0) {
+		mSortKeys.extract(mOmnisList, pRowCount);
+		key.mSortKeys = mSortKeys;
+		mSortKeys.clear();
+		key.mHash = (key.mHash ^ key.mSortKeys.fingerprint()) * 1099511628211ULL;
+	};
+	
+	if ((mSharedModel != NULL) && mSharedModel->key().matches(key)) {
+		// nothing changed
+		return;
+	};
+	
+	oDLSharedModel *	model = oDLSharedModel::find(key);
+	if (model == NULL) {
+		// nobody has built this yet
+		oDLNode	newRoot;
+		
+		if (adjacency) {
+			qlong	cycles = buildAdjacencyTree(key.mSnapshot, newRoot);
+			if (cycles > 0) {
+				addToTraceLog("oDataList: broke %li cycle(s) in parent ids", cycles);
+			};
+		} else {
+			buildColumnGroupTree(key.mSnapshot, newRoot);
+		};
+		
+		if (key.mSortKeys.columnCount() > 0) {
+			newRoot.sortChildren(&key.mSortKeys);
+		} else if (!adjacency) {
+			newRoot.sortChildren();
+		};
+		
+		// our model takes over our key
+		model = oDLSharedModel::publish(key, newRoot);
+	};
+	
+	// carry over which nodes we had collapsed
+	std::set<const oDLNode *>	collapsed;
+	carryCollapsed(rootNode(), model->root(), collapsed);
+	
+	if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row) || (mMouseHitTest.mAbove==oDL_treeIcon)) {
+		// we're about to replace all nodes so this can't be valid anymore
+		clearHitTest();
+	};
+	
+	if (mSharedModel != NULL) {
+		mSharedModel->release();
+	} else {
+		mRootNode.clearChildNodes();
+	};
+	mSharedModel = model;
+	mCollapsedNodes.swap(collapsed);
+};
+
+// Is this line visible in our tree? Answered from the index we built when we last drew our nodes
+bool	oDataList::isLineVisible(qlong pLineNo) {
+	if ((pLineNo < 1) || (pLineNo >= (qlong) mVisibleIndex.size())) {
+		return false;
+	};
+	
+	return mVisibleIndex[pLineNo] != -1;
+};
+
+// Select or deselect the lines after pFrom up to and including pTo like pFrom, lines that aren't visible are deselected
+void	oDataList::extendSelection(qlong pFrom, qlong pTo) {
+	bool	select = mSelection.isSelected(pFrom);
+	qlong	first = pFrom < pTo ? pFrom + 1 : pTo;
+	qlong	last = pFrom < pTo ? pTo : pFrom - 1;
+	
+	mSelection.selectRange(first, last, select);
+	
+	if (select) {
+		// lines hidden in collapsed nodes or filtered out should not be selected
+		for (qlong line = first; line <= last; line++) {
+			if (!isLineVisible(line)) {
+				mSelection.select(line, false);
+			};
+		};
+	};
+};
+
+// Fingerprint of the contents of our list and the settings we build our tree with, mOmnisList must be set
+unsigned long long	oDataList::stateFingerprint(EXTCompInfo* pECI, qlong pRowCount) {
+	unsigned long long	hash = 14695981039346656037ULL;
+	qlong				colCount = mOmnisList->colCnt();
+	qstring				sortColumns;
+	
+	// everything that changes how we build and sort our tree or measure our rows
+	oDLStateStream::hashString(hash, mFilter);
+	for (unsigned long group = 0; group < mGroupCalculations.size(); group++) {
+		oDLStateStream::hashString(hash, *mGroupCalculations[group].mGroupCalc);
+		oDLStateStream::hashString(hash, mGroupCalculations[group].mParentCalc != NULL ? *mGroupCalculations[group].mParentCalc : qstring(QTEXT("")));
+	};
+	oDLStateStream::hashLong(hash, mIdColumn);
+	oDLStateStream::hashLong(hash, mParentIdColumn);
+	oDLStateStream::hashLong(hash, mGroupColumns.size());
+	for (unsigned long i = 0; i < mGroupColumns.size(); i++) {
+		oDLStateStream::hashLong(hash, mGroupColumns[i]);
+	};
+	mSortKeys.columnsAsString(sortColumns);
+	oDLStateStream::hashString(hash, sortColumns);
+	oDLStateStream::hashString(hash, mColumnPrefix);
+	oDLStateStream::hashLong(hash, mColumnCount);
+	for (qulong i = 0; i < mColumnCount; i++) {
+		oDLStateStream::hashString(hash, *mColumnCalculations[i]);
+	};
+	
+	// and the contents of our list, reading our values is much cheaper than evaluating our calculations
+	oDLStateStream::hashLong(hash, pRowCount);
+	oDLStateStream::hashLong(hash, colCount);
+	for (qlong lineno = 1; lineno <= pRowCount; lineno++) {
+		for (qlong col = 1; col <= colCount; col++) {
+			EXTfldval	colFld;
+			
+			mOmnisList->getColValRef(lineno, col, colFld, qfalse);
+			oDLStateStream::hashString(hash, qstring(colFld));
+		};
+	};
+	
+	// 0 means we have no fingerprint
+	return hash == 0 ? 1 : hash;
+};
+
+// Write the child nodes of this node to our state
+void	oDataList::saveNodeState(oDLStateStream & pStream, oDLNode & pNode) {
+	pStream.putLong(pNode.childNodeCount());
+	for (unsigned long index = 0; index < pNode.childNodeCount(); index++) {
+		oDLNode *	child = pNode.getChildByIndex(index);
+		
+		pStream.putLong(child->lineNo());
+		pStream.putLong(child->sortOrder());
+		pStream.putLong(isNodeExpanded(child) ? 1 : 0);
+		pStream.putString(child->value());
+		pStream.putString(child->description());
+		saveNodeState(pStream, *child);
+	};
+};
+
+// Read child nodes for this node from our state, returns false if our state is invalid
+bool	oDataList::loadNodeState(oDLStateStream & pStream, oDLNode & pNode) {
+	qlong	count = pStream.getLong();
+	
+	for (qlong index = 0; (index < count) && !pStream.failed(); index++) {
+		qlong		lineNo		= pStream.getLong();
+		qlong		sortOrder	= pStream.getLong();
+		bool		expanded	= pStream.getLong() != 0;
+		qstring		value, description;
+		
+		pStream.getString(value);
+		pStream.getString(description);
+		if (pStream.failed()) {
+			break;
+		};
+		
+		oDLNode *	child = new oDLNode(value, description, lineNo);
+		child->setSortOrder(sortOrder);
+		child->setExpanded(expanded);
+		pNode.addNode(child);
+		
+		if (!loadNodeState(pStream, *child)) {
+			return false;
+		};
+	};
+	
+	return !pStream.failed();
+};
+
+// Save our tree, expanded state, row heights and scroll position as a binary, together with a fingerprint of our list so we know if we can restore it
+void	oDataList::saveState(EXTCompInfo* pECI, EXTfldval & pState) {
+	oDLStateStream	stream;
+	
+	checkColumns();
+	mOmnisList = mVirtualRowCount > 0 ? NULL : getNamedList(mListName, pECI);
+	if (mOmnisList == NULL) {
+		// nothing to save
+		pState.setEmpty(fftBinary, 0);
+		return;
+	};
+	
+	stream.putLong(oDL_stateMagic);
+	stream.putLong(oDL_stateVersion);
+	stream.putHash(stateFingerprint(pECI, mOmnisList->rowCnt()));
+	
+	delete mOmnisList;
+	mOmnisList = 0;
+	
+	stream.putLong(mVertScrollPos);
+	stream.putLong(mHorzScrollPos);
+	stream.putLong(mLastCurrentLineTop);
+	saveNodeState(stream, rootNode());
+	
+	stream.putLong(mCellHeights.size());
+	for (std::map<unsigned long long, sDLCellHeight>::iterator it = mCellHeights.begin(); it != mCellHeights.end(); it++) {
+		stream.putHash(it->first);
+		stream.putLong(it->second.mWidth);
+		stream.putLong(it->second.mHeight);
+	};
+	
+	const std::vector<qbyte> &	data = stream.data();
+	pState.setBinary(fftBinary, (qbyte *) &data[0], data.size());
+};
+
+// Restore a state saved with saveState, returns false if the state is invalid or doesn't match our list and settings
+bool	oDataList::loadState(EXTCompInfo* pECI, EXTfldval & pState) {
+	qlong	stateLen = pState.getBinLen();
+	
+	if ((stateLen <= 0) || (mVirtualRowCount > 0)) {
+		// nothing to restore or nothing to restore it to
+		return false;
+	};
+	
+	std::vector<qbyte>	buffer(stateLen);
+	qlong				realLen;
+	pState.getBinary(stateLen, &buffer[0], realLen);
+	
+	oDLStateStream		stream(&buffer[0], realLen);
+	if ((stream.getLong() != oDL_stateMagic) || (stream.getLong() != oDL_stateVersion)) {
+		// not our state
+		return false;
+	};
+	
+	unsigned long long	fingerprint = stream.getHash();
+	
+	checkColumns();
+	mOmnisList = getNamedList(mListName, pECI);
+	if (mOmnisList == NULL) {
+		return false;
+	};
+	qlong	rowCount = mOmnisList->rowCnt();
+	bool	matches = fingerprint == stateFingerprint(pECI, rowCount);
+	delete mOmnisList;
+	mOmnisList = 0;
+	
+	if (!matches) {
+		// our list or our settings changed, we need to rebuild anyway
+		return false;
+	};
+	
+	qdim		vertScrollPos		= stream.getLong();
+	qdim		horzScrollPos		= stream.getLong();
+	qdim		lastCurrentLineTop	= stream.getLong();
+	oDLNode		newRoot;
+	
+	if (!loadNodeState(stream, newRoot)) {
+		return false;
+	};
+	
+	std::map<unsigned long long, sDLCellHeight>	cellHeights;
+	qlong		heightCount = stream.getLong();
+	for (qlong i = 0; (i < heightCount) && !stream.failed(); i++) {
+		unsigned long long	key = stream.getHash();
+		sDLCellHeight &		cell = cellHeights[key];
+		
+		cell.mWidth		= stream.getLong();
+		cell.mHeight	= stream.getLong();
+	};
+	if (stream.failed()) {
+		return false;
+	};
+	
+	// we're good, replace what we have
+	cancelAsyncRebuild();
+	releaseSharedModel();
+	if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row) || (mMouseHitTest.mAbove==oDL_treeIcon)) {
+		// we're about to replace all nodes so this can't be valid anymore
+		clearHitTest();
+	};
+	clearVisibleIndex();
+	mRootNode.clearChildNodes();
+	mRootNode.swapChildNodes(newRoot);
+	mCellHeights.swap(cellHeights);
+	mCellTexts.clear();
+	mPrefixIndex.clear();
+	
+	mVertScrollPos		= vertScrollPos;
+	mVertScrollOffset	= 0;
+	mHorzScrollPos		= horzScrollPos;
+	mLastCurrentLineTop	= lastCurrentLineTop;
+	WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);
+	WNDsetScrollPos(mHWnd, SB_HORZ, mHorzScrollPos, qtrue);
+	
+	// draw what we restored without rebuilding or remeasuring
+	mStateFingerprint	= fingerprint;
+	mStateRowCount		= rowCount;
+	mRebuildNodes		= false;
+	mScrollOnlyPaint	= true;
+	WNDinvalidateRect(mHWnd, NULL);
+	
+	return true;
+};
+
+// Add a line to pList for each node below pNode, depth first in the order we draw them
+void	oDataList::addTreeRows(EXTqlist * pList, oDLNode & pNode, qlong pLevel) {
+	for (unsigned long index = 0; index < pNode.childNodeCount(); index++) {
+		oDLNode *	child = pNode.getChildByIndex(index);
+		EXTfldval	colFld;
+		qlong		rowNo = pList->insertRow();
+		
+		pList->getColValRef(rowNo, 1, colFld, qtrue);
+		colFld.setLong(pLevel);
+		pList->getColValRef(rowNo, 2, colFld, qtrue);
+		colFld.setChar((qchar *) child->value().cString(), child->value().length());
+		pList->getColValRef(rowNo, 3, colFld, qtrue);
+		colFld.setChar((qchar *) child->description().cString(), child->description().length());
+		pList->getColValRef(rowNo, 4, colFld, qtrue);
+		colFld.setLong(child->lineNo());
+		pList->getColValRef(rowNo, 5, colFld, qtrue);
+		colFld.setBool(isNodeExpanded(child) ? 2 : 1);
+		pList->getColValRef(rowNo, 6, colFld, qtrue);
+		colFld.setLong(child->childNodeCount());
+		
+		addTreeRows(pList, *child, pLevel + 1);
+	};
+};
+
+// Rebuild our nodes using our id and parent id columns
+void	oDataList::buildAdjacencyNodes(EXTCompInfo* pECI, qlong pRowCount) {
+	sDLSnapshot			snapshot;
+	std::vector<qlong>	columns;
+	
+	columns.push_back(mIdColumn);
+	columns.push_back(mParentIdColumn);
+	takeSnapshot(pECI, pRowCount, columns, snapshot);
+	
+	// build into a new root so we can carry over the expanded state of our current nodes
+	oDLNode	newRoot;
+	qlong	cycles = buildAdjacencyTree(snapshot, newRoot);
+	if (cycles > 0) {
+		addToTraceLog("oDataList: broke %li cycle(s) in parent ids", cycles);
+	};
+	
+	swapInNodes(newRoot);
+};
+
+// Build a tree from id/parent id pairs, returns the number of cycles we had to break
+qlong	oDataList::buildAdjacencyTree(const sDLSnapshot & pSnapshot, oDLNode & pRoot, oAtomic * pCancel, oAtomic * pProgress) {
+	qlong					count = (qlong) pSnapshot.mLines.size();
+	qlong					cycles = 0;
+	std::vector<qlong>		parents(count, -1);
+	std::vector<qbyte>		state(count, 0);		// 0 = not checked, 1 = on our current path, 2 = checked
+	std::vector<qlong>		path;
+	std::vector<oDLNode *>	nodes(count, (oDLNode *) NULL);
+	
+	// index our ids, if an id is used twice the first line wins
+	std::map<oDLKey, qlong>	index;
+	for (qlong i = 0; i < count; i++) {
+		index.insert(std::make_pair(pSnapshot.value(i, 0), i));
+	};
+	
+	// find our parents, lines without a (visible) parent end up at our root
+	for (qlong i = 0; i < count; i++) {
+		const oDLKey &	parentId = pSnapshot.value(i, 1);
+		if (parentId.length() > 0) {
+			std::map<oDLKey, qlong>::iterator found = index.find(parentId);
+			if (found != index.end()) {
+				parents[i] = found->second;
+			};
+		};
+	};
+	
+	if ((pCancel != NULL) && (pCancel->get() != 0)) {
+		// no longer needed
+		return 0;
+	};
+	
+	// walk up from each line, if we end up back on our own path we've found a cycle and we break it by making that line a root line
+	// every line is only walked once so this stays linear
+	for (qlong i = 0; i < count; i++) {
+		qlong	line = i;
+		
+		while ((line != -1) && (state[line] == 0)) {
+			state[line] = 1;
+			path.push_back(line);
+			line = parents[line];
+		};
+		
+		if ((line != -1) && (state[line] == 1)) {
+			parents[line] = -1;
+			cycles++;
+		};
+		
+		while (path.size() > 0) {
+			state[path.back()] = 2;
+			path.pop_back();
+		};
+	};
+	
+	// create our nodes
+	for (qlong i = 0; i < count; i++) {
+		if (((i & 0xFFF) == 0) && (pProgress != NULL)) {
+			pProgress->set(i);
+			if ((pCancel != NULL) && (pCancel->get() != 0)) {
+				// no longer needed, clean up what we've created so far
+				for (qlong j = 0; j < i; j++) {
+					delete nodes[j];
+				};
+				return 0;
+			};
+		};
+		
+		qstring		value;
+		oDLNode::keyToString(pSnapshot.value(i, 0), value);
+		
+		nodes[i] = new oDLNode(value, qstring(QTEXT("")), pSnapshot.mLines[i]);
+		nodes[i]->setSortOrder(pSnapshot.mLines[i]);
+	};
+	
+	// and link them up, as we add them in line order our children are already sorted
+	for (qlong i = 0; i < count; i++) {
+		if (parents[i] == -1) {
+			pRoot.addNode(nodes[i]);
+		} else {
+			nodes[parents[i]]->addNode(nodes[i]);
+		};
+	};
+	
+	return cycles;
+};
+
+// Rebuild our nodes grouping on the values in our group columns
+void	oDataList::buildColumnGroupedNodes(EXTCompInfo* pECI, qlong pRowCount) {
+	sDLSnapshot		snapshot;
+	
+	takeSnapshot(pECI, pRowCount, mGroupColumns, snapshot);
+	
+	// build into a new root so we can carry over the expanded state of our current nodes
+	oDLNode	newRoot;
+	buildColumnGroupTree(snapshot, newRoot);
+	
+	swapInNodes(newRoot);
+};
+
+// Group a range of lines in our snapshot, this runs on a worker thread
+void	oDataList::groupSnapshotRange(void * pRange) {
+	sDLGroupRange *	range = (sDLGroupRange *) pRange;
+	
+	for (qlong i = range->mFrom; i < range->mTo; i++) {
+		if (((i - range->mFrom) & 0xFFF) == 0xFFF) {
+			if ((range->mCancel != NULL) && (range->mCancel->get() != 0)) {
+				// no longer needed
+				return;
+			};
+			if (range->mProgress != NULL) {
+				range->mProgress->add(0x1000);
+			};
+		};
+		
+		range->mBucket->addLine(&range->mSnapshot->value(i, 0), range->mSnapshot->mColumns, range->mSnapshot->mLines[i]);
+	};
+};
+
+// Build a tree grouping the lines in our snapshot on its values, large snapshots are split over multiple threads
+void	oDataList::buildColumnGroupTree(const sDLSnapshot & pSnapshot, oDLNode & pRoot, oAtomic * pCancel, oAtomic * pProgress) {
+	qlong			count = (qlong) pSnapshot.mLines.size();
+	unsigned int	threads = oThread::hardwareConcurrency();
+	
+	// only split up our work if there is enough of it to be worth starting threads for
+	if (threads < 1) {
+		threads = 1;
+	};
+	if ((qlong) threads > (count / 10000)) {
+		threads = (unsigned int) (count / 10000);
+		if (threads < 1) {
+			threads = 1;
+		};
+	};
+	
+	oDLGroupBucket *			buckets = new oDLGroupBucket[threads];
+	oThread *					workers = new oThread[threads];
+	std::vector<sDLGroupRange>	ranges(threads);
+	qlong						chunk = (count + threads - 1) / threads;
+	
+	// each thread groups its own range of lines into its own buckets
+	for (unsigned int t = 0; t < threads; t++) {
+		ranges[t].mSnapshot	= &pSnapshot;
+		ranges[t].mFrom		= t * chunk > count ? count : t * chunk;
+		ranges[t].mTo		= ranges[t].mFrom + chunk > count ? count : ranges[t].mFrom + chunk;
+		ranges[t].mBucket	= &buckets[t];
+		ranges[t].mCancel	= pCancel;
+		ranges[t].mProgress	= pProgress;
+	};
+	
+	// we do the first range ourselves, as well as any range we couldn't start a thread for
+	for (unsigned int t = 1; t < threads; t++) {
+		if (!workers[t].start(groupSnapshotRange, &ranges[t])) {
+			groupSnapshotRange(&ranges[t]);
+		};
+	};
+	groupSnapshotRange(&ranges[0]);
+	
+	for (unsigned int t = 1; t < threads; t++) {
+		workers[t].join();
+	};
+	delete [] workers;
+	
+	if ((pCancel == NULL) || (pCancel->get() == 0)) {
+		// merge in order so our lines remain sorted
+		for (unsigned int t = 1; t < threads; t++) {
+			buckets[0].merge(buckets[t]);
+		};
+		
+		buckets[0].buildNodes(pRoot, pCancel);
+	};
+	
+	delete [] buckets;
+};
+
+// Snapshot our list and rebuild our nodes on a background thread, unless the data is the same as our last rebuild
+void	oDataList::startAsyncRebuild(EXTCompInfo* pECI, qlong pRowCount, bool pForce) {
+	sDLRebuildJob *		job = new sDLRebuildJob();
+	std::vector<qlong>	columns;
+	
+	job->mAdjacency	= (mIdColumn > 0) && (mParentIdColumn > 0);
+	job->mCycles	= 0;
+	
+	if (job->mAdjacency) {
+		columns.push_back(mIdColumn);
+		columns.push_back(mParentIdColumn);
+	} else {
+		columns = mGroupColumns;
+	};
+	takeSnapshot(pECI, pRowCount, columns, job->mSnapshot);
+	
+	unsigned long long	fingerprint = job->mSnapshot.fingerprint() ^ (job->mAdjacency ? 1 : 0);
+	if ((!pForce) && (fingerprint == mAsyncFingerprint)) {
+		// nothing changed since our last rebuild, keep what we have (or what is being built)
+		delete job;
+		return;
+	};
+	
+	// any rebuild still running is now out of date
+	cancelAsyncRebuild();
+	
+	if (!job->mThread.start(runRebuildJob, job)) {
+		// no thread for us, build it right here so we still end up with a tree
+		runRebuildJob(job);
+	} else if (!startIdleTimer()) {
+		// nothing will tell us when our rebuild is done, wait for it so we still end up with a tree
+		job->mThread.join();
+	};
+	
+	mAsyncFingerprint	= fingerprint;
+	mAsyncRowCount		= pRowCount;
+	mRebuildJob			= job;
+};
+
+// Cancel any rebuild running in the background
+void	oDataList::cancelAsyncRebuild(void) {
+	if (mRebuildJob != NULL) {
+		mRebuildJob->mCancel.set(1);
+		mRebuildJob->mThread.join();
+		delete mRebuildJob;
+		mRebuildJob = NULL;
+		
+		// make sure the next rebuild isn't skipped
+		mAsyncFingerprint = 0;
+	};
+};
+
+// Swap in the result of our background rebuild if it has finished, returns true if we did
+bool	oDataList::checkAsyncRebuild(void) {
+	if ((mRebuildJob == NULL) || (mRebuildJob->mDone.get() == 0)) {
+		return false;
+	};
+	
+	mRebuildJob->mThread.join();
+	if (mRebuildJob->mCycles > 0) {
+		addToTraceLog("oDataList: broke %li cycle(s) in parent ids", mRebuildJob->mCycles);
+	};
+	swapInNodes(mRebuildJob->mRoot);
+	
+	delete mRebuildJob;
+	mRebuildJob = NULL;
+	
+	return true;
+};
+
+// Make sure mIdleTimer is running, returns false if we couldn't start it
+bool	oDataList::startIdleTimer(void) {
+	if (mIdleTimer.running()) {
+		return true;
+	};
+	
+	return mIdleTimer.start(ODL_IDLEINTERVAL, idleTimer, this);
+};
+
+// Called by mIdleTimer in between handling messages while we wait on our background rebuild or have rows to prefetch
+void	oDataList::idleTimer(void * pList) {
+	oDataList *	list = (oDataList *) pList;
+	
+	if ((list->mOmnisList != NULL) || list->mPainting) {
+		// we're in the middle of handling something, try again next time
+		return;
+	};
+	
+	if (list->mRebuildJob == NULL) {
+		// nothing to wait on
+	} else if (list->mRebuildJob->mDone.get() != 0) {
+		// our next paint swaps in our new tree, it snapshots our list again so any change made while we were building is picked up
+		WNDinvalidateRect(list->mHWnd, NULL);
+	} else if (list->mRootNode.childNodeCount() == 0) {
+		// update our progress
+		list->invalidateOwn(NULL);
+	};
+	
+	if (list->mPrefetchLines.size() > 0) {
+		// draw anything that is waiting to be drawn first, so the paint we ask for next only continues our prefetch and can trust what we drew before
+		WNDupdateWindow(list->mHWnd);
+	};
+	
+	if (list->mPrefetchLines.size() > 0) {
+		// we just need the paint, not a redraw
+		qrect	idleRect;
+		
+		idleRect.left	= list->mClientRect.left;
+		idleRect.top	= list->mClientRect.top;
+		idleRect.right	= list->mClientRect.left + 1;
+		idleRect.bottom	= list->mClientRect.top + 1;
+		
+		list->mPrefetchPaint = true;
+		WNDinvalidateRect(list->mHWnd, &idleRect);
+		WNDupdateWindow(list->mHWnd);
+		
+		if (list->mPrefetchPaint) {
+			// we weren't drawn, we're probably not visible, our next paint starts over
+			list->mPrefetchPaint = false;
+			list->mPrefetchLines.clear();
+		};
 	};
-
-	// cleanup...
-	while(columndata.numberOfElements()>0) {
-		qstring * olddata = columndata.pop();
-		delete olddata;
+	
+	if (((list->mRebuildJob == NULL) || (list->mRebuildJob->mDone.get() != 0)) && (list->mPrefetchLines.size() == 0)) {
+		// nothing left to do, we're started again when there is
+		list->mIdleTimer.stop();
 	};
+};
+
+// Build the tree for our job, this runs on our background thread so it may only touch our job
+void	oDataList::runRebuildJob(void * pJob) {
+	sDLRebuildJob *	job = (sDLRebuildJob *) pJob;
 	
-	mOmnisList->setCurRow(oldCurRow);
+	if (job->mAdjacency) {
+		job->mCycles = buildAdjacencyTree(job->mSnapshot, job->mRoot, &job->mCancel, &job->mProgress);
+	} else {
+		buildColumnGroupTree(job->mSnapshot, job->mRoot, &job->mCancel, &job->mProgress);
+		
+		// sort our nodes on the first line that relates to them
+		job->mRoot.sortChildren(NULL, &job->mCancel);
+	};
 	
-	return pTop + lineheight;
+	job->mProgress.set(job->mSnapshot.mLines.size());
+	job->mDone.set(1);
 };
 
-
 // Do our drawing in here
 void oDataList::doPaint(EXTCompInfo* pECI) {
 	// The way this is structured is that as long as the contents of the list doesn't change nor the way we display our list, we reuse as much of what we've calculated before
@@ -343,8 +1732,15 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
 	// After that we skip as much of the logic as we can and effectively only draw lines that are visible.
 
 	qbool	redraw = false; // if our scroll position changes, we draw twice!
+	bool	rebuilt = false; // if a background rebuild finished, we let Omnis know once we're done drawing
+	std::vector<qlong>	needPages; // pages we need to ask Omnis for in virtual mode, we ask once we're done drawing
 	clock_t	t = clock();
 	
+	// keep track of what this paint costs
+	mPainting			= true;
+	mPaintCacheMisses	= 0;
+	mPaintRows			= 0;
+	
 	// call base class to draw background
 	oBaseVisComponent::doPaint(pECI);
 	
@@ -373,9 +1769,41 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
     
 	// check our columns
 	checkColumns();
+	
+	bool	scrollOnly = mScrollOnlyPaint || mPrefetchPaint;
+	bool	prefetchPaint = mPrefetchPaint;
+	bool	ownPaint = mOwnPaint;
+	bool	idlePaint = prefetchPaint && !mScrollOnlyPaint && !ownPaint; // only continuing our prefetch, nothing we drew last time has changed
+	if (!scrollOnly) {
+		// our data may have changed, only while scrolling can we trust the texts and heights we evaluated before
+		mCellHeights.clear();
+		mCellTexts.clear();
+	};
+	mScrollOnlyPaint = false;
+	mPrefetchPaint = false;
+	mOwnPaint = false;
 		
 	if ( ECOisDesign(mHWnd) ) {
 		// Don't draw anything else..
+	} else if (mVirtualRowCount > 0) {
+		// we don't have a list, we draw what we have in our cache
+		drawVirtualRows(needPages);
+		
+		// add one extra line for spacing...
+		qlong	listLineNo	= mVirtualRowCount + 1;
+		qlong	pageSize	= listLineNo > 4 ? 4 : listLineNo;
+		
+		if (mVertScrollPos > listLineNo - pageSize) {
+			qdim newScrollPos		= listLineNo - pageSize;
+			newScrollPos			= newScrollPos > 0 ? newScrollPos : 0;
+			
+			if (mVertScrollPos != newScrollPos) {
+				mVertScrollPos = newScrollPos;
+				WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);				
+				redraw = true;
+			};
+		};
+		WNDsetScrollRange(mHWnd, SB_VERT, 0, listLineNo, pageSize, qtrue);
 	} else {
         // Get our omnis list
 		mOmnisList = getNamedList(mListName, pECI);
@@ -385,189 +1813,160 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
 		} else {
 			qlong		rowCount = mOmnisList->rowCnt();
 			qlong		currentRow = mOmnisList->getCurRow();
+			qlong		listLineNo = 0;	// this will count the total of lines we have in our list including our grouping lines, excluding any collapsed lines
 			
-            mRebuildNodes = true; // for now always true, we need to improve on this somehow!
-			if (mRebuildNodes) {
-				// Update our nodes7
-				mRootNode.unTouchChildren(); // untouch children
+			if (idlePaint && !mRebuildNodes && ((qlong) mVisibleIndex.size() == rowCount + 1)) {
+				// we're only continuing our prefetch and nothing else changed, draw what we drew last time again instead of walking our tree
+				redrawVisibleNodes(pECI);
+				listLineNo = mListLineCount;
+			} else {
+				bool		rebuildRequested = mRebuildNodes;
+				bool		restored = false;
 				
-				if (rowCount!=0) {
-					// !BAS! need to investigate if we can cache these calculations and reuse them....
-					
-					// setup our filter calculation
-					EXTfldval *		filtercalc = NULL;
-					if (mFilter.length() > 0) {
-						filtercalc = newCalculation(mFilter, pECI);
+				if (mStateFingerprint != 0) {
+					if (!rebuildRequested && scrollOnly && (rowCount == mStateRowCount)) {
+						// we checked our data when we restored our state, we keep showing it for the paint that follows and while we're only scrolling
+						restored = true;
+					} else {
+						// our data may have changed, rebuild as normal, the nodes we restored keep their expanded state
+						mStateFingerprint = 0;
+						rebuildRequested = true;
 					};
+				};
+				
+				// our nodes may be replaced, we rebuild our index when we draw them
+				clearVisibleIndex();
+				
+				if (!scrollOnly) {
+					// our list may have changed, scrolling doesn't change it so we keep what we read before
+					mSelectionStale = true;
+				};
+				if (mShowSelected) {
+					// read our selection once instead of asking for each line we draw
+					loadSelection();
+				};
+
+				bool		fromSnapshot = ((mIdColumn > 0) && (mParentIdColumn > 0)) || (mGroupColumns.size() > 0);
+				bool		useAsync = mAsyncRebuild && fromSnapshot;
+				
+				mRebuildNodes = rebuildRequested || !scrollOnly; // while only scrolling our data hasn't changed, else for now always true unless we restored our state, we need to improve on this somehow!
+				if (restored) {
+					// keep what we restored
+					mRebuildNodes = false;
+				} else if (useAsync) {
+					// we build our own tree in the background
+					releaseSharedModel();
 					
-					// setup our grouping calculations
-					EXTfldvalArray	groupcalcs;
-					EXTfldvalArray	parentcalcs;
-					unsigned int	group;					
-					
-					// loop through our list
-					for (group = 0; group < mGroupCalculations.size(); group++) {
-						sDLGrouping	grouping	= mGroupCalculations[group];
-						EXTfldval *	calcFld		= newCalculation(*grouping.mGroupCalc, pECI);
-						
-						if (calcFld != NULL) {
-							groupcalcs.push_back(calcFld);
-							
-							// also our parent calculation..
-							EXTfldval * parentFld = NULL;
-							if (grouping.mParentCalc != NULL) {
-								parentFld = newCalculation(*grouping.mParentCalc, pECI);
-							};
-							parentcalcs.push_back(parentFld); // always add even if NULL
-						};
+					// only snapshot our list again if it may have changed, not while scrolling or redrawing after our own changes
+					if (rebuildRequested || (rowCount != mAsyncRowCount) || (!ownPaint && !scrollOnly)) {
+						startAsyncRebuild(pECI, rowCount, rebuildRequested);
 					};
 					
-					
-					for (qlong lineno = 1; lineno <= rowCount; lineno++) {
-						bool		showNode = true;
-						oDLNode *	node = &mRootNode;
-						
-						mOmnisList->setCurRow(lineno);
-						
-						if (filtercalc != NULL) {
-							EXTfldval	result;
-							filtercalc->evalCalculation(result, pECI->mLocLocp, mOmnisList, qfalse);
-							if (result.getBool() != 2) {
-								showNode = false;
-							};
-						};
-						
-						if (showNode) {
-							bool	addFinalNode = true;
-							
-							// check our grouping
-							group = 0;
-							while(addFinalNode && (group < groupcalcs.size())) {
-								EXTfldval * calcFld = groupcalcs[group];
-								EXTfldval	result;
-								
-								calcFld->evalCalculation(result, pECI->mLocLocp, mOmnisList, qfalse);
-								qstring		groupdesc(result), value;
-								
-								if (groupdesc.length()>0) {
-									oDLNode *childnode;
-									
-									// we split our description by |. This will allow us to optionally include a unique identifier
-									qlong	pos = groupdesc.pos('|');
-									if (pos > 0) {
-										value		= groupdesc.mid(0,pos);
-										groupdesc	= groupdesc.mid(pos+1);
-										childnode	= node->findChildByValue(value);
-									} else {
-										value		= "";
-										if (pos == 0) {
-											groupdesc	= groupdesc.mid(pos+1);
-										};
-										childnode	= node->findChildByDescription(groupdesc, true);
-									};
-									
-									if (childnode == NULL) {
-										childnode = new oDLNode(value, groupdesc, 0);
-										node->addNode(childnode);
-									} else {
-										childnode->setTouched(true);
-									};
-									
-									if (childnode->sortOrder()==0) {
-										// set the sort order to the first line related to our node
-										childnode->setSortOrder(lineno);
-									};
-									
-									EXTfldval * parentFld = parentcalcs[group];
-									if (parentFld != NULL) {
-										EXTfldval	isParent;
-										parentFld->evalCalculation(isParent, pECI->mLocLocp, mOmnisList, qfalse);
-										
-										if (isParent.getBool()==2) {
-											childnode->setLineNo(lineno);
-											addFinalNode = false; // we've already found it
-										};
-									};
-																		
-									node = childnode;									
-								};
-								
-								group++;
-							};
-							
-							if (addFinalNode) {
-								// now add our final node, if this is a self reference node it would already have been added
-								oDLNode * finalNode = node->findChildByLineNo(lineno);
-								if (finalNode!=NULL) {
-									finalNode->setTouched(true);
-								} else {
-									finalNode = new oDLNode(qstring(""), qstring(""), lineno);
-									finalNode->setSortOrder(lineno);
-									node->addNode(finalNode);									
-								};
-							};
-						};
-					};					
-					
-					// cleanup our EXTFlds
-					while (parentcalcs.size()) {
-						EXTfldval *	calcFld = parentcalcs.back();
-						parentcalcs.pop_back();
-						
-						if (calcFld != NULL) {
-							delete calcFld;							
+					if (checkAsyncRebuild()) {
+						// our data changed
+						mPrefixIndex.clear();
+
+						if (mSortKeys.columnCount() > 0) {
+							// sort our nodes on our sort columns, our list itself is left alone
+							mSortKeys.extract(mOmnisList, rowCount);
+							mRootNode.sortChildren(&mSortKeys);
+							mSortKeys.clear();
 						};
-					};
-					while (groupcalcs.size()) {
-						EXTfldval *	calcFld = groupcalcs.back();
-						groupcalcs.pop_back();
 						
-						delete calcFld;
+						mOmnisList->setCurRow(currentRow);
+						rebuilt = true;
 					};
-					if (filtercalc != NULL) {
-						delete filtercalc;
+					
+					mRebuildNodes = false;
+				} else if (mRebuildNodes) {
+					// make sure a background rebuild doesn't overwrite what we build here
+					cancelAsyncRebuild();
+					
+					if (!(mSharedTree && fromSnapshot)) {
+						// we're building our own tree
+						releaseSharedModel();
 					};
 					
-					// check if our hittest info is still valid
-					if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row)) {
-						oDLNode *	childnode = mMouseHitTest.mNode;
-						
-						if (childnode->touched() == false) {
-							// this node was not touched and will be removed, our hittest data is no longer valid
-							clearHitTest();						
-						} else if (mMouseHitTest.mLineNo != 0) {
-							if (childnode->lineNo()!=mMouseHitTest.mLineNo) {
-								clearHitTest();														
-							};
+					if (mSharedTree && fromSnapshot) {
+						// use the same tree as other data lists showing this data, we only take a new snapshot if we're asked to rebuild or our number of lines changed
+						if (rebuildRequested || (mSharedModel == NULL) || (rowCount != mSharedRowCount)) {
+							buildSharedNodes(pECI, rowCount);
+							mSharedRowCount = rowCount;
 						};
+					} else if ((mIdColumn > 0) && (mParentIdColumn > 0)) {
+						// build our tree from our id and parent id columns
+						buildAdjacencyNodes(pECI, rowCount);
+					} else if (mGroupColumns.size() > 0) {
+						// group on the values in our group columns
+						buildColumnGroupedNodes(pECI, rowCount);
+					} else {
+						buildGroupedNodes(pECI, rowCount);
 					};
 					
-					// remove untouched children
-					mRootNode.removeUntouched();
-					
-					// sort our nodes
-					mRootNode.sortChildren();
+					if (mSharedModel != NULL) {
+						// already sorted when it was built
+					} else if (mSortKeys.columnCount() > 0) {
+						// sort our nodes on our sort columns, our list itself is left alone
+						mSortKeys.extract(mOmnisList, rowCount);
+						mRootNode.sortChildren(&mSortKeys);
+						mSortKeys.clear();
+					} else if ((mIdColumn == 0) || (mParentIdColumn == 0)) {
+						// sort our nodes on the first line that relates to them
+						mRootNode.sortChildren();
+					};
 					
 					// make sure our current row is current again, we need this later!
 					mOmnisList->setCurRow(currentRow);
+					
+					mRebuildNodes = false;
+				};
+							
+				// Now draw our stuff, when smooth scrolling our first line may be partially visible
+				qdim	top				= mSmoothScroll ? -mVertScrollOffset : 0;
+				listLineNo				= 0;
+				bool	isEven			= false;
+				size_t	capacity		= mVisibleNodes.capacity();
+				mLastVisListNo			= 0;
+				if (mVisibleIndex.capacity() < (size_t) rowCount + 1) {
+					mPaintCacheMisses++;
+				};
+				mVisibleIndex.assign(rowCount + 1, -1);
+				mDrawParentIndex		= -1;
+				mContentHeight			= 0;
+				mRowEstimate			= 2 + mCanvas->getFontHeight() + mLineSpacing;
+				top = drawNode(pECI, rootNode(), -1, top, listLineNo, isEven);
+				mListLineCount			= listLineNo;
+				if (mVisibleNodes.capacity() != capacity) {
+					// our index had to grow
+					mPaintCacheMisses++;
+				};
+			};
+			
+			if ((mRebuildJob != NULL) && (mRootNode.childNodeCount() == 0)) {
+				// nothing to show yet, let the user know we're working on it, idleTimer redraws our progress
+				qstring	placeholder;
+				qrect	placeholderRect = mClientRect;
+				
+				placeholder.appendFormattedString("Loading %li of %li lines...", mRebuildJob->mProgress.get(), (qlong) mRebuildJob->mSnapshot.mLines.size());
+				placeholderRect.top += mLineSpacing;
+				placeholderRect.left += mIndent;
+				mCanvas->drawText(placeholder.cString(), placeholderRect, mTextColor, jstLeft, true, true);
+			};
+			
+			if (mPrefetchRows > 0) {
+				if (!prefetchPaint) {
+					// start over around our new visible rows
+					queuePrefetch();
 				} else {
-					if ((mMouseHitTest.mAbove==oDL_node) || (mMouseHitTest.mAbove==oDL_row)) {
-						// we're about to remove all nodes so this can't be valid anymore
-						clearHitTest();						
-					};
-
-					mRootNode.clearChildNodes();
+					// idleTimer asked us to repaint because we were idle, continue evaluating the rows around us
+					prefetchRows(pECI);
 				};
 				
-				mRebuildNodes = false;
+				if ((mPrefetchLines.size() > 0) && !startIdleTimer()) {
+					// without our timer we can't tell when we're idle
+					mPrefetchLines.clear();
+				};
 			};
-						
-			// Now draw our stuff...		
-			qdim	top				= 0;
-			qlong	listLineNo		= 0;	// this will count the total of lines we have in our list including our grouping lines, excluding any collapsed lines
-			bool	isEven			= false;
-			mLastVisListNo			= 0;
-			top = drawNode(pECI, mRootNode, -1, top, listLineNo, isEven);
 			
 			// add one extra line for spacing...
 			listLineNo++;
@@ -577,18 +1976,39 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
 			
 //			addToTraceLog("First vis: %li, Last vis: %li, Total lines: %li", mVertScrollPos+1, mLastVisListNo, listLineNo);
 			
-			// update our vertical scroll range which we now do in line numbers, this may trigger another redraw..
-			if (mVertScrollPos > listLineNo - pageSize) {
-				qdim newScrollPos		= listLineNo - pageSize;
-				newScrollPos			= newScrollPos > 0 ? newScrollPos : 0;
+			if (mSmoothScroll) {
+				// our scroll range is in pixels, add one extra line for spacing
+				qdim	height		= mContentHeight + mRowEstimate;
+				qdim	page		= mClientRect.height() > 1 ? mClientRect.height() : 1;
+				qlong	first		= firstVisibleIndex();
+				qdim	pixels		= (first < (qlong) mVisibleNodes.size() ? mVisibleNodes[first].mOffset : mContentHeight) + mVertScrollOffset;
+				qdim	maxPixels	= height - page > 0 ? height - page : 0;
 				
-				if (mVertScrollPos != newScrollPos) {
-					mVertScrollPos = newScrollPos;
-					WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);				
-					redraw = true;
+				if (pixels > maxPixels) {
+					qlong	wasScrollPos = mVertScrollPos;
+					qdim	wasOffset = mVertScrollOffset;
+					
+					setSmoothScrollPos(maxPixels);
+					pixels = maxPixels;
+					redraw = (wasScrollPos != mVertScrollPos) || (wasOffset != mVertScrollOffset);
+				};
+				
+				WNDsetScrollRange(mHWnd, SB_VERT, 0, height, page, qtrue);
+				WNDsetScrollPos(mHWnd, SB_VERT, pixels, qtrue);
+			} else {
+				// update our vertical scroll range which we now do in line numbers, this may trigger another redraw..
+				if (mVertScrollPos > listLineNo - pageSize) {
+					qdim newScrollPos		= listLineNo - pageSize;
+					newScrollPos			= newScrollPos > 0 ? newScrollPos : 0;
+					
+					if (mVertScrollPos != newScrollPos) {
+						mVertScrollPos = newScrollPos;
+						WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);				
+						redraw = true;
+					};
 				};
+				WNDsetScrollRange(mHWnd, SB_VERT, 0, listLineNo, pageSize, qtrue);
 			};
-			WNDsetScrollRange(mHWnd, SB_VERT, 0, listLineNo, pageSize, qtrue);
 									
 			// We are done with our list...
 			mOmnisList->setCurRow(currentRow);
@@ -599,7 +2019,7 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
 			if (currentRow!=0) {
 				// !BAS! Need to redo this now that we use line numbers, we should find our node by list line number and scroll accordingly
 				
-				qdim	currentListLine = mRootNode.findListLineNo(currentRow);
+				qdim	currentListLine = isLineVisible(currentRow) ? mVisibleNodes[mVisibleIndex[currentRow]].mListLineNo : -1;
 				
 				// addToTraceLog("Current list line: %li, was: %li", currentListLine, mLastCurrentLineTop);
 				
@@ -616,7 +2036,10 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
 					newScrollPos = newScrollPos > 0 ? newScrollPos : 0;
 					if (mVertScrollPos != newScrollPos) {
 						mVertScrollPos = newScrollPos;
-						WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);
+						mVertScrollOffset = 0;
+						if (!mSmoothScroll) {
+							WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);
+						};
 						redraw = true;
 					};
 
@@ -649,12 +2072,33 @@ void oDataList::doPaint(EXTCompInfo* pECI) {
 	}
 	WNDsetScrollRange(mHWnd, SB_HORZ, 0, maxHorzScroll, horzPageSize, qtrue);
 
+	// we're done with what we compiled for this paint
+	clearPaintColumns();
+	mPainting	= false;
+	mPaintTime	= ((clock()-t) * 1000)/CLOCKS_PER_SEC;
+	
 	// addToTraceLog("finished drawing in %li ms",((clock()-t) * 1000)/CLOCKS_PER_SEC);
 	
 	if (redraw) {
 		// just draw again, may need to protect against recursive calls? I think it'll be alright.
 		doPaint(pECI);
 	};
+	
+	if (rebuilt) {
+		// our new nodes are on screen
+		sendEvent(oDL_evRebuilt, 0, 0);
+	};
+	
+	for (qulong i = 0; i < needPages.size(); i++) {
+		// ask Omnis for the rows we're missing, it should call $setrows to give them to us
+		qlong		from = (needPages[i] * mRowCache.pageSize()) + 1;
+		qlong		count = mVirtualRowCount - from + 1;
+		EXTfldval	evParam[2];
+		
+		evParam[0].setLong(from);
+		evParam[1].setLong(count < mRowCache.pageSize() ? count : mRowCache.pageSize());
+		sendEvent(oDL_evNeedRows, evParam, 2);
+	};
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -697,6 +2141,16 @@ ECOproperty oDataListProperties[] = {
 
 	oDL_filtercalc,				4122,	fftCharacter,	EXTD_FLAG_PROPDATA
 														+EXTD_FLAG_FAR_SRCH,	0,		0,			0,		// $filtercalc
+	oDL_idColumn,				4125,	fftInteger,		EXTD_FLAG_PROPDATA,		0,		0,			0,		// $idcolumn
+	oDL_parentIdColumn,			4126,	fftInteger,		EXTD_FLAG_PROPDATA,		0,		0,			0,		// $parentidcolumn
+	oDL_sortColumns,			4127,	fftCharacter,	EXTD_FLAG_PROPDATA,		0,		0,			0,		// $sortcolumns
+	oDL_groupColumns,			4128,	fftCharacter,	EXTD_FLAG_PROPDATA,		0,		0,			0,		// $groupcolumns
+	oDL_asyncRebuild,			4129,	fftBoolean,		EXTD_FLAG_PROPDATA,		0,		0,			0,		// $asyncrebuild
+	oDL_virtualRows,			4130,	fftInteger,		EXTD_FLAG_PROPDATA,		0,		0,			0,		// $virtualrows
+	oDL_virtualWindow,			4131,	fftInteger,		EXTD_FLAG_PROPDATA,		0,		0,			0,		// $virtualwindow
+	oDL_sharedTree,				4132,	fftBoolean,		EXTD_FLAG_PROPDATA,		0,		0,			0,		// $sharedtree
+	oDL_prefetchRows,			4133,	fftInteger,		EXTD_FLAG_PROPAPP,		0,		0,			0,		// $prefetchrows
+	oDL_smoothScroll,			4134,	fftBoolean,		EXTD_FLAG_PROPAPP,		0,		0,			0,		// $smoothscroll
 };	
 
 qProperties * oDataList::properties(void) {
@@ -712,6 +2166,11 @@ qProperties * oDataList::properties(void) {
 qbool oDataList::setProperty(qlong pPropID,EXTfldval &pNewValue,EXTCompInfo* pECI) {
 	// most anum properties are managed by Omnis but some we need to do ourselves, no idea why...
 	
+	// anything we change here may change the heights of our rows and the values we find on
+	mScrollOnlyPaint = false;
+	mPrefetchPaint = false;
+	mPrefixIndex.clear();
+	
 	switch (pPropID) {
         case anumListName: {
             mListName = pNewValue;
@@ -922,6 +2381,7 @@ qbool oDataList::setProperty(qlong pPropID,EXTfldval &pNewValue,EXTCompInfo* pEC
 			mRebuildNodes = true;
 			mLastCurrentLineTop = 0;
 			mVertScrollPos = 0;
+			mVertScrollOffset = 0;
             WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qfalse); // no need to redraw, we're about to redraw the whole control...
 			WNDinvalidateRect(mHWnd, NULL);
 			
@@ -981,6 +2441,121 @@ qbool oDataList::setProperty(qlong pPropID,EXTfldval &pNewValue,EXTCompInfo* pEC
 			WNDinvalidateRect(mHWnd, NULL);
 			return qtrue;
 		}; break;
+		case oDL_idColumn:
+		case oDL_parentIdColumn: {
+			qlong	column = pNewValue.getLong();
+			if (column < 0) column = 0;
+			
+			if (pPropID == oDL_idColumn) {
+				mIdColumn = column;
+			} else {
+				mParentIdColumn = column;
+			};
+			
+			// our nodes are built completely differently in this mode so start fresh
+			cancelAsyncRebuild();
+			releaseSharedModel();
+			clearHitTest();
+			clearVisibleIndex();
+			mRootNode.clearChildNodes();
+			mRebuildNodes = true;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_sortColumns: {
+			mSortKeys.setColumns(qstring(pNewValue));
+			mRebuildNodes = true;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_groupColumns: {
+			qstring		columns(pNewValue);
+			qlong		column = 0;
+			
+			mGroupColumns.clear();
+			
+			for (qulong i = 0; i <= columns.length(); i++) {
+				qchar	digit = i < columns.length() ? columns[i] : ',';
+				
+				if (digit == ',') {
+					if (column > 0) {
+						mGroupColumns.push_back(column);
+					};
+					column = 0;
+				} else if ((digit >= '0') && (digit <= '9')) {
+					column = 10 * column;
+					column += digit - '0';
+				};
+			};
+			
+			// our nodes are built differently in this mode so start fresh
+			cancelAsyncRebuild();
+			releaseSharedModel();
+			clearHitTest();
+			clearVisibleIndex();
+			mRootNode.clearChildNodes();
+			mRebuildNodes = true;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_virtualRows: {
+			qlong	rowCount = pNewValue.getLong();
+			
+			// our rows may have changed completely
+			mVirtualRowCount = rowCount > 0 ? rowCount : 0;
+			mVirtualCurrentRow = mVirtualCurrentRow > mVirtualRowCount ? 0 : mVirtualCurrentRow;
+			mRowCache.clear();
+			mVirtualRowBottoms.clear();
+			clearHitTest();
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_virtualWindow: {
+			qlong	window = pNewValue.getLong();
+			mVirtualWindow = window > 0 ? window : 0;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_smoothScroll: {
+			mSmoothScroll = pNewValue.getBool() == 2;
+			mVertScrollOffset = 0;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_prefetchRows: {
+			qlong	rows = pNewValue.getLong();
+			mPrefetchRows = rows > 0 ? rows : 0;
+			mPrefetchLines.clear();
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_sharedTree: {
+			mSharedTree = pNewValue.getBool() == 2;
+			if (!mSharedTree) {
+				releaseSharedModel();
+			};
+			mRebuildNodes = true;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
+		case oDL_asyncRebuild: {
+			mAsyncRebuild = pNewValue.getBool() == 2;
+			if (!mAsyncRebuild) {
+				cancelAsyncRebuild();
+			};
+			mRebuildNodes = true;
+			
+			WNDinvalidateRect(mHWnd, NULL);
+			return qtrue;
+		}; break;
 		default:
 			return oBaseVisComponent::setProperty(pPropID, pNewValue, pECI);
 			break;
@@ -1148,6 +2723,55 @@ qbool oDataList::getProperty(qlong pPropID,EXTfldval &pGetValue,EXTCompInfo* pEC
 			pGetValue.setChar((qchar *)parentcalcs.cString(), parentcalcs.length());
             return true;
 		}; break;
+		case oDL_idColumn: {
+			pGetValue.setLong(mIdColumn);
+			return true;
+		}; break;
+		case oDL_parentIdColumn: {
+			pGetValue.setLong(mParentIdColumn);
+			return true;
+		}; break;
+		case oDL_sortColumns: {
+			qstring	columns;
+			mSortKeys.columnsAsString(columns);
+			pGetValue.setChar((qchar *)columns.cString(), columns.length());
+			return true;
+		}; break;
+		case oDL_groupColumns: {
+			qstring	columns;
+			for (qulong i = 0; i < mGroupColumns.size(); i++) {
+				if (i != 0) {
+					columns += QTEXT(",");
+				};
+				columns.appendFormattedString("%li", mGroupColumns[i]);
+			};
+			pGetValue.setChar((qchar *)columns.cString(), columns.length());
+			return true;
+		}; break;
+		case oDL_asyncRebuild: {
+			pGetValue.setBool(mAsyncRebuild ? 2 : 1);
+			return true;
+		}; break;
+		case oDL_sharedTree: {
+			pGetValue.setBool(mSharedTree ? 2 : 1);
+			return true;
+		}; break;
+		case oDL_virtualRows: {
+			pGetValue.setLong(mVirtualRowCount);
+			return true;
+		}; break;
+		case oDL_virtualWindow: {
+			pGetValue.setLong(mVirtualWindow);
+			return true;
+		}; break;
+		case oDL_prefetchRows: {
+			pGetValue.setLong(mPrefetchRows);
+			return true;
+		}; break;
+		case oDL_smoothScroll: {
+			pGetValue.setBool(mSmoothScroll ? 2 : 1);
+			return true;
+		}; break;
 		default:
 			return oBaseVisComponent::getProperty(pPropID, pGetValue, pECI);
 			
@@ -1179,6 +2803,20 @@ ECOparam oDataListLineAtPosParam[] = {
 	//	Resource	Type		Flags		ExFlags
 	7003,			fftInteger,	0,			0,		// pY
 };
+ECOparam oDataListFindParam[] = {
+	//	Resource	Type			Flags					ExFlags
+	7007,			fftCharacter,	0,						0,		// pText
+	7008,			fftInteger,		EXTD_FLAG_PARAMOPT,		0,		// pColumn
+};
+ECOparam oDataListLoadStateParam[] = {
+	//	Resource	Type		Flags		ExFlags
+	7009,			fftBinary,	0,			0,		// pState
+};
+ECOparam oDataListSetRowsParam[] = {
+	//	Resource	Type		Flags		ExFlags
+	7004,			fftInteger,	0,			0,		// pFrom
+	7006,			fftList,	0,			0,		// pList
+};
 
 // This is our array of methods we support
 ECOmethodEvent oDataListMethods[] = {
@@ -1186,6 +2824,14 @@ ECOmethodEvent oDataListMethods[] = {
 	1,				8010,		fftBoolean,		1,				oDataListIsVisibleParam,	0,			0,			// $isVisible
 	2,				8011,		fftInteger,		1,				oDataListLineAtPosParam,	0,			0,			// $lineAtPos
 	3,				8012,		fftInteger,		0,				0,							0,			0,			// $lineAtMouse
+	4,				8013,		fftBoolean,		2,				oDataListSetRowsParam,		0,			0,			// $setRows
+	5,				8014,		fftInteger,		2,				oDataListFindParam,			0,			0,			// $find
+	6,				8015,		fftBinary,		0,				0,							0,			0,			// $savestate
+	7,				8016,		fftBoolean,		1,				oDataListLoadStateParam,	0,			0,			// $loadstate
+	8,				8017,		fftList,		0,				0,							0,			0,			// $visiblerows
+	9,				8018,		fftList,		0,				0,							0,			0,			// $treeaslist
+	10,				8019,		fftList,		0,				0,							0,			0,			// $paintstats
+	11,				8020,		fftBoolean,		0,				0,							0,			0,			// $rebuild
 };
 
 // return an array of method meta data
@@ -1203,56 +2849,228 @@ int	oDataList::invokeMethod(qlong pMethodId, EXTCompInfo* pECI) {
 		case 1: {
 			EXTfldval	lvResult;
 			qlong		lvLineNo = getLongFromParam(1, pECI);
-			qdim		lvAt = mRootNode.findTopForLine(lvLineNo);
+			if (!isLineVisible(lvLineNo)) {
+				// no top position? = not visible
+				lvResult.setBool(1);
+			} else {
+				// visible!
+				lvResult.setBool(2);				
+			};
+	 
+			ECOaddParam(pECI, &lvResult);
+			return 1L;							
+		}; break;
+		case 2: {
+			EXTfldval	lvResult;
+			qlong		lvY = getLongFromParam(1, pECI);
+
+			qpoint at(40, lvY);
+			sDLHitTest hittest = doHitTest(at);
+
+			if ((hittest.mAbove == oDL_row) || (hittest.mAbove == oDL_node)) {
+				lvResult.setLong(hittest.mLineNo);
+			} else {
+				lvResult.setLong(0);
+			};
+
+					  
+			ECOaddParam(pECI, &lvResult);
+			return 1L;							
+		}; break;
+		case 3: {
+			EXTfldval	lvResult;
+			qpoint pt;
+			
+			// get our mouse position and map it to our control so 0,0 is the left-top of our control
+			WNDgetCursorPos(&pt);
+			WNDmapWindowPoint(HWND_DESKTOP, mHWnd, &pt);
+			
+			// should test if pt is above our field...
+
+			sDLHitTest hittest = doHitTest(pt);
+			
+			if ((hittest.mAbove == oDL_row) || (hittest.mAbove == oDL_node)) {
+				lvResult.setLong(hittest.mLineNo);
+			} else {
+				lvResult.setLong(0);
+			};
+			
+			ECOaddParam(pECI, &lvResult);
+			return 1L;							
+		}; break;
+		case 4: {
+			EXTfldval		lvResult;
+			qlong			lvFrom = getLongFromParam(1, pECI);
+			EXTParamInfo *	lvParam = ECOfindParamNum(pECI, 2);
+			
+			if ((mVirtualRowCount == 0) || (lvParam == NULL)) {
+				// not in virtual mode or no list
+				lvResult.setBool(1);
+			} else {
+				EXTfldval	lvListFld((qfldval) lvParam->mData);
+				EXTqlist *	lvList = lvListFld.getList(qfalse);
+				
+				if (lvList == NULL) {
+					lvResult.setBool(1);
+				} else {
+					setVirtualRows(pECI, lvFrom, lvList);
+					mScrollOnlyPaint = false;
+					mPrefetchPaint = false;
+					delete lvList;
+					
+					// and redraw with our new rows
+					WNDinvalidateRect(mHWnd, NULL);
+					lvResult.setBool(2);
+				};
+			};
+			
+			ECOaddParam(pECI, &lvResult);
+			return 1L;
+		}; break;
+		case 5: {
+			EXTfldval		lvResult;
+			EXTParamInfo *	lvParam = ECOfindParamNum(pECI, 1);
+			qlong			lvColumn = ECOgetParamCount(pECI) > 1 ? getLongFromParam(2, pECI) : 1;
+			qlong			lvLineNo = 0;
+			
+			mOmnisList = (lvParam == NULL) || (mVirtualRowCount > 0) ? NULL : getNamedList(mListName, pECI);
+			if (mOmnisList != NULL) {
+				EXTfldval	lvTextFld((qfldval) lvParam->mData);
+				qstring		lvText(lvTextFld);
+				oDLKey		lvPrefix = oDLNode::keyFromString(lvText);
+				
+				oDLNode::foldKey(lvPrefix);
+				
+				qlong		lvTo = findVisiblePrefix(pECI, lvPrefix, lvColumn, false);
+				if (lvTo >= 0) {
+					qlong	lvFrom = isLineVisible(mOmnisList->getCurRow()) ? mVisibleIndex[mOmnisList->getCurRow()] : -1;
+					
+					lvLineNo = moveToVisibleIndex(lvFrom, lvTo, false);
+				};
+				
+				delete mOmnisList;
+				mOmnisList = 0;
+			};
+			
+			lvResult.setLong(lvLineNo);
+			ECOaddParam(pECI, &lvResult);
+			return 1L;
+		}; break;
+		case 6: {
+			EXTfldval		lvResult;
+			
+			saveState(pECI, lvResult);
+			
+			ECOaddParam(pECI, &lvResult);
+			return 1L;
+		}; break;
+		case 7: {
+			EXTfldval		lvResult;
+			EXTParamInfo *	lvParam = ECOfindParamNum(pECI, 1);
+			bool			lvRestored = false;
 			
-			if (lvAt==-1) {
-				// no top position? = not visible
-				lvResult.setBool(1);
-			} else {
-				// visible!
-				lvResult.setBool(2);				
+			if (lvParam != NULL) {
+				EXTfldval	lvStateFld((qfldval) lvParam->mData);
+				
+				lvRestored = loadState(pECI, lvStateFld);
 			};
-	 
+			
+			lvResult.setBool(lvRestored ? 2 : 1);
 			ECOaddParam(pECI, &lvResult);
-			return 1L;							
+			return 1L;
 		}; break;
-		case 2: {
-			EXTfldval	lvResult;
-			qlong		lvY = getLongFromParam(1, pECI);
-
-			qpoint at(40, lvY);
-			sDLHitTest hittest = doHitTest(at);
-
-			if ((hittest.mAbove == oDL_row) || (hittest.mAbove == oDL_node)) {
-				lvResult.setLong(hittest.mLineNo);
-			} else {
-				lvResult.setLong(0);
+		case 8: {
+			EXTfldval		lvResult;
+			EXTqlist *		lvList = new EXTqlist(listVlen);
+			str255			lvColName;
+			
+			lvColName = QTEXT("LineNo");
+			lvList->addCol(1, fftInteger, 0, 0, NULL, &lvColName);
+			
+			// our flattened index holds the visible nodes in the order we drew them
+			for (qulong i = 0; i < mVisibleNodes.size(); i++) {
+				qlong	lvLineNo = mVisibleNodes[i].mNode->lineNo();
+				
+				if (lvLineNo > 0) {
+					EXTfldval	lvColFld;
+					qlong		lvRowNo = lvList->insertRow();
+					
+					lvList->getColValRef(lvRowNo, 1, lvColFld, qtrue);
+					lvColFld.setLong(lvLineNo);
+				};
 			};
-
-					  
+			
+			lvResult.setList(lvList, qtrue);
+			delete lvList;
+			
 			ECOaddParam(pECI, &lvResult);
-			return 1L;							
+			return 1L;
 		}; break;
-		case 3: {
-			EXTfldval	lvResult;
-			qpoint pt;
+		case 9: {
+			EXTfldval		lvResult;
+			EXTqlist *		lvList = new EXTqlist(listVlen);
+			str255			lvColName;
+			
+			lvColName = QTEXT("Level");
+			lvList->addCol(1, fftInteger, 0, 0, NULL, &lvColName);
+			lvColName = QTEXT("Value");
+			lvList->addCol(2, fftCharacter, dpFcharacter, 10000000, NULL, &lvColName);
+			lvColName = QTEXT("Description");
+			lvList->addCol(3, fftCharacter, dpFcharacter, 10000000, NULL, &lvColName);
+			lvColName = QTEXT("LineNo");
+			lvList->addCol(4, fftInteger, 0, 0, NULL, &lvColName);
+			lvColName = QTEXT("Expanded");
+			lvList->addCol(5, fftBoolean, 0, 0, NULL, &lvColName);
+			lvColName = QTEXT("ChildCount");
+			lvList->addCol(6, fftInteger, 0, 0, NULL, &lvColName);
+			
+			addTreeRows(lvList, rootNode(), 1);
+			
+			lvResult.setList(lvList, qtrue);
+			delete lvList;
 			
-			// get our mouse position and map it to our control so 0,0 is the left-top of our control
-			WNDgetCursorPos(&pt);
-			WNDmapWindowPoint(HWND_DESKTOP, mHWnd, &pt);
+			ECOaddParam(pECI, &lvResult);
+			return 1L;
+		}; break;
+		case 10: {
+			EXTfldval		lvResult;
+			EXTqlist *		lvList = new EXTqlist(listVlen);
+			str255			lvColName;
+			EXTfldval		lvColFld;
+			
+			lvColName = QTEXT("Milliseconds");
+			lvList->addCol(1, fftInteger, 0, 0, NULL, &lvColName);
+			lvColName = QTEXT("CacheMisses");
+			lvList->addCol(2, fftInteger, 0, 0, NULL, &lvColName);
+			lvColName = QTEXT("Rows");
+			lvList->addCol(3, fftInteger, 0, 0, NULL, &lvColName);
+			
+			qlong			lvRowNo = lvList->insertRow();
+			lvList->getColValRef(lvRowNo, 1, lvColFld, qtrue);
+			lvColFld.setLong(mPaintTime);
+			lvList->getColValRef(lvRowNo, 2, lvColFld, qtrue);
+			lvColFld.setLong(mPaintCacheMisses);
+			lvList->getColValRef(lvRowNo, 3, lvColFld, qtrue);
+			lvColFld.setLong(mPaintRows);
+			
+			lvResult.setList(lvList, qtrue);
+			delete lvList;
 			
-			// should test if pt is above our field...
-
-			sDLHitTest hittest = doHitTest(pt);
+			ECOaddParam(pECI, &lvResult);
+			return 1L;
+		}; break;
+		case 11: {
+			EXTfldval		lvResult;
 			
-			if ((hittest.mAbove == oDL_row) || (hittest.mAbove == oDL_node)) {
-				lvResult.setLong(hittest.mLineNo);
-			} else {
-				lvResult.setLong(0);
-			};
+			// our list data changed in a way we can't see from our number of lines, take a new snapshot on our next paint
+			mRebuildNodes = true;
+			mScrollOnlyPaint = false;
+			mPrefetchPaint = false;
+			WNDinvalidateRect(mHWnd, NULL);
 			
+			lvResult.setBool(2);
 			ECOaddParam(pECI, &lvResult);
-			return 1L;							
+			return 1L;
 		}; break;
 		default: {
 			return oBaseVisComponent::invokeMethod(pMethodId, pECI);
@@ -1269,6 +3087,11 @@ ECOparam oDataListevClickParam[] = {
 	//	Resource	Type		Flags		ExFlags
 	7001,			fftInteger,	0,			0,		// pLineNo
 };
+ECOparam oDataListevNeedRowsParam[] = {
+	//	Resource	Type		Flags		ExFlags
+	7004,			fftInteger,	0,			0,		// pFrom
+	7005,			fftInteger,	0,			0,		// pCount
+};
 
 ECOmethodEvent oDataListEvents[] = {
 	//	ID					Resource	Return type		Paramcount		Params					Flags		ExFlags
@@ -1277,6 +3100,8 @@ ECOmethodEvent oDataListEvents[] = {
 	oDL_evVScrolled,		5002,		0,				0,				0,						0,			0,
 	oDL_evColumnResized,	5003,		0,				0,				0,						0,			0,
 	oDL_evDoubleClick,		5004,		0,				0,				0,						0,			0,
+	oDL_evRebuilt,			5005,		0,				0,				0,						0,			0,
+	oDL_evNeedRows,			5006,		0,				2,				oDataListevNeedRowsParam,	0,		0,
 };	
 
 // return an array of events meta data
@@ -1295,6 +3120,11 @@ qEvents *	oDataList::events(void) {
 
 // get our vertical step size
 qdim oDataList::getVertStepSize(void) {
+	if (mSmoothScroll && (mVirtualRowCount == 0)) {
+		// we scroll in pixels, step by a line
+		return mRowEstimate;
+	};
+	
 	return 4;
 };
 
@@ -1302,16 +3132,26 @@ qdim oDataList::getVertStepSize(void) {
 void oDataList::evWindowScrolled(qdim pNewX, qdim pNewY) {
 	qdim pWasX = mHorzScrollPos;
 	qdim pWasY = mVertScrollPos;
+	qdim pWasOffset = mVertScrollOffset;
 	
 	// call base class
 	oBaseVisComponent::evWindowScrolled(pNewX, pNewY);
 	
+	if (mSmoothScroll && (mVirtualRowCount == 0)) {
+		// our scrollbar works in pixels, find the line at this position using the offsets of our last paint.
+		// We only update our position here, any number of scroll events before our next paint end up in a single paint
+		setSmoothScrollPos(pNewY);
+	};
+	
+	// our next paint can reuse the row texts and heights we measured
+	mScrollOnlyPaint = true;
+	
 	// This should become part of our base class if we can use Omnis' internal values
 	if (mHorzScrollPos!=pWasX) {
-		ECOsendEvent(mHWnd, oDL_evHScrolled, 0, 0, EEN_EXEC_IMMEDIATE);		
+		sendEvent(oDL_evHScrolled, 0, 0);		
 	};
-	if (mVertScrollPos!=pWasY) {
-		ECOsendEvent(mHWnd, oDL_evVScrolled, 0, 0, EEN_EXEC_IMMEDIATE);				
+	if ((mVertScrollPos!=pWasY) || (mVertScrollOffset!=pWasOffset)) {
+		sendEvent(oDL_evVScrolled, 0, 0);				
 	};
 };
 
@@ -1354,11 +3194,46 @@ sDLHitTest	oDataList::doHitTest(qpoint pAt) {
 		};
 	};
 		
-	// Now check if we're above a node
+	if (mVirtualRowCount > 0) {
+		// in virtual mode we only have rows
+		above.mColNo	= 0;
+		above.mNode		= NULL;
+		
+		qdim	top = 0;
+		for (qulong i = 0; i < mVirtualRowBottoms.size(); i++) {
+			if ((pAt.v >= top) && (pAt.v < mVirtualRowBottoms[i])) {
+				above.mAbove	= oDL_row;
+				above.mLineNo	= mVertScrollPos + 1 + i;
+				return above;
+			};
+			top = mVirtualRowBottoms[i];
+		};
+		
+		above.mAbove	= oDL_none;
+		above.mLineNo	= 0;
+		return above;
+	};
+	
+	// Now check if we're above a node, our tops only increase so we can search our flattened index
+	qlong	first = 0;
+	qlong	last = mVisibleNodes.size();
+	while (first < last) {
+		qlong	middle = (first + last) / 2;
+		if (mVisibleNodes[middle].mTop <= pAt.v) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		};
+	};
+	
 	above.mColNo	= 0;
-	above.mNode		= mRootNode.findChildByPoint(pAt);
-	if (above.mNode != NULL) {
-		if (above.mNode->aboveTreeIcon(pAt)) {
+	above.mNode		= NULL;
+	if ((first > 0) && (pAt.v < mVisibleNodes[first - 1].mRowBottom)) {
+		const sDLVisibleNode &	entry = mVisibleNodes[first - 1];
+		const qrect &			icon = entry.mTreeIconRect;
+		
+		above.mNode = entry.mNode;
+		if ((entry.mNode->childNodeCount() > 0) && (icon.left <= pAt.h) && (icon.right >= pAt.h) && (icon.top <= pAt.v) && (icon.bottom >= pAt.v)) {
 			above.mAbove	= oDL_treeIcon;
 			above.mLineNo	= 0;
 		} else {
@@ -1396,6 +3271,8 @@ HCURSOR	oDataList::getCursor(qpoint pAt, qword2 pHitTest) {
 
 // mouse left button pressed down (return true if we finished handling this, false if we want Omnis internal logic)
 bool	oDataList::evMouseLDown(qpoint pDownAt) {
+	mPrefetchLines.clear(); // the user needs us, stop prefetching
+	
 	mMouseHitTest = this->doHitTest(pDownAt); // where did our mouse come down?
 	mMouseLast = pDownAt; // remember this to calculate deltas
 	
@@ -1420,9 +3297,9 @@ void	oDataList::evMouseMoved(qpoint pMovedTo) {
 			};
 			
 			mColumnWidths.setElementAtIndex(mMouseHitTest.mColNo, newWidth);
-			WNDinvalidateRect(mHWnd, NULL);
+			invalidateOwn(NULL);
 			
-			ECOsendEvent(mHWnd, oDL_evColumnResized, 0, 0, EEN_EXEC_IMMEDIATE);
+			sendEvent(oDL_evColumnResized, 0, 0);
 		};
 		mMouseLast = pMovedTo;
 	};
@@ -1447,9 +3324,9 @@ void	oDataList::evClick(qpoint pAt, EXTCompInfo* pECI) {
 				break;
 			case oDL_treeIcon: {
 				// toggle our node
-				bool isExpanded = mMouseHitTest.mNode->expanded();
-				mMouseHitTest.mNode->setExpanded(isExpanded==false);
-				WNDinvalidateRect(mHWnd, NULL);
+				bool isExpanded = isNodeExpanded(mMouseHitTest.mNode);
+				setNodeExpanded(mMouseHitTest.mNode, isExpanded==false);
+				invalidateOwn(NULL);
 				
 				// maybe send a click event back to Omnis?
 			}; break;
@@ -1457,90 +3334,74 @@ void	oDataList::evClick(qpoint pAt, EXTCompInfo* pECI) {
                 if (isEnabled()) {
                     if ((mOmnisList != NULL) && mDeselectOnNodeClick) {
                         if (mShowSelected) {
-                            // deselect all
-                            qlong	rowCnt = mOmnisList->rowCnt();
-						
-                            for (qlong row = 1; row<=rowCnt; row++) {
-                                mOmnisList->selectRow(row, qfalse, qfalse);
-                            };
+                            // deselect all, we only need to touch the lines that are selected
+                            loadSelection();
+                            mSelection.selectAll(false);
+                            mSelection.push(mOmnisList);
                         } else {
                             // deselect the current row
                             qlong	row = mOmnisList->getCurRow();
                             if (row != 0) {
                                 mOmnisList->selectRow(row, qfalse, qfalse);
+                                mSelectionStale = true;
                             };
                         };
 					
                         mOmnisList->setCurRow(0);
 					
                         // and redraw
-                        WNDinvalidateRect(mHWnd, NULL);
+                        invalidateOwn(NULL);
                     };
 				
                     // let user know we clicked outside of our line
                     EXTfldval	evParam[1];
                     evParam[0].setLong(0);
-                    ECOsendEvent(mHWnd, oDL_evClick, evParam, 1, EEN_EXEC_IMMEDIATE);
+                    sendEvent(oDL_evClick, evParam, 1);
                 };
 			}; break;
 			case oDL_row: {
                 if (isEnabled()) {
                     //			addToTraceLog("Clicked on row %li at %li, %li",mMouseHitTest.mLineNo, pAt.h,pAt.v);
 				
-                    if (mOmnisList != NULL) {
+                    if (mVirtualRowCount > 0) {
+                        // in virtual mode we track our current row ourselves
+                        mVirtualCurrentRow = mMouseHitTest.mLineNo;
+                    } else if (mOmnisList != NULL) {
                         qlong	currentRow = mOmnisList->getCurRow();
-                        qlong	rowCnt = mOmnisList->rowCnt();
 					
+                        // we make our changes to our selection bitset and update our list in one go
+                        loadSelection();
+                        
                         if ((isShift() == 1) && (currentRow!=0) && (mShowSelected)) {
                             // select from the current line to the line we clicked on, then make that line current
-                            qlong	isSelected = mOmnisList->isRowSelected(currentRow, qfalse);
-						
-                            while (currentRow!=mMouseHitTest.mLineNo) {
-                                if (currentRow > mMouseHitTest.mLineNo) {
-                                    currentRow--;
-                                } else {
-                                    currentRow++;
-                                };
-							
-                                qdim		lvAt = mRootNode.findTopForLine(currentRow);
-			
-                                if (lvAt==-1) {
-                                    // no top position? = not visible, don't select it
-                                    mOmnisList->selectRow(currentRow, qfalse, qfalse);
-                                } else {
-                                    mOmnisList->selectRow(currentRow, isSelected, qfalse);
-                                };
-                            };
+                            extendSelection(currentRow, mMouseHitTest.mLineNo);
 						
                             // and make this our new current row
                             mOmnisList->setCurRow(mMouseHitTest.mLineNo);
                         } else {
                             if ((isControl() != 0) && (mShowSelected)) { /* note, control on windows, cmnd on mac */
                                 // toggle the line we clicked on
-                                qlong	isSelected = mOmnisList->isRowSelected(mMouseHitTest.mLineNo, qfalse);
-                                mOmnisList->selectRow(mMouseHitTest.mLineNo, !isSelected, qfalse);
+                                mSelection.select(mMouseHitTest.mLineNo, !mSelection.isSelected(mMouseHitTest.mLineNo));
                             } else {
-                                // deselect all lines...
-                                for (qlong row = 1; row<=rowCnt; row++) {
-                                    mOmnisList->selectRow(row, qfalse, qfalse);
-                                };
-							
-                                // select the line we clicked on and make it current
-                                mOmnisList->selectRow(mMouseHitTest.mLineNo, qtrue, qfalse);
+                                // deselect all lines and select the line we clicked on
+                                mSelection.selectAll(false);
+                                mSelection.select(mMouseHitTest.mLineNo, true);
                             };
 						
                             // do make it the current row
                             mOmnisList->setCurRow(mMouseHitTest.mLineNo);
                         };
+                        
+                        mSelection.push(mOmnisList);
                     };
 				
                     // and redraw
-                    WNDinvalidateRect(mHWnd, NULL);
+                    invalidateOwn(NULL);
 				
                     // let user know we clicked on a line
                     EXTfldval	evParam[1];
                     evParam[0].setLong(mMouseHitTest.mLineNo);
-                    ECOsendEvent(mHWnd, oDL_evClick, evParam, 1, EEN_EXEC_IMMEDIATE);
+                    sendEvent(oDL_evClick, evParam, 1);
                 };
 			};	break;
 			default:
@@ -1565,14 +3426,14 @@ bool	oDataList::evDoubleClick(qpoint pAt, EXTCompInfo* pECI) {
 				// double click on our icon we ignore, but double click on our node we treat like we clicked on our icon
 				
 				// toggle our node
-				bool isExpanded = mMouseHitTest.mNode->expanded();
-				mMouseHitTest.mNode->setExpanded(isExpanded==false);
-				WNDinvalidateRect(mHWnd, NULL);
+				bool isExpanded = isNodeExpanded(mMouseHitTest.mNode);
+				setNodeExpanded(mMouseHitTest.mNode, isExpanded==false);
+				invalidateOwn(NULL);
 				
 				// maybe send a click event back to Omnis?
 			};	break;
 			case oDL_row: {
-				ECOsendEvent(mHWnd, oDL_evDoubleClick, 0, 0, EEN_EXEC_IMMEDIATE);				
+				sendEvent(oDL_evDoubleClick, 0, 0);				
 			};	break;
 			default:
 				break;
@@ -1585,16 +3446,31 @@ bool	oDataList::evDoubleClick(qpoint pAt, EXTCompInfo* pECI) {
 
 // mouse right button pressed down (return true if we finished handling this, false if we want Omnis internal logic)
 bool	oDataList::evMouseRDown(qpoint pDownAt, EXTCompInfo* pECI) {
+	mPrefetchLines.clear(); // the user needs us, stop prefetching
+	
 	bool enabled = (isEnabled() && isActive() && ECOisOMNISinTrueRuntime(mHWnd));
 	if (enabled) {
 		// make sure the line we're over is selected!
 		mMouseHitTest = this->doHitTest(pDownAt); // redo our hittest just in case
 		
+		if (mVirtualRowCount > 0) {
+			// in virtual mode we don't have a list, just make the line we clicked on current
+			if ((mMouseHitTest.mAbove == oDL_row) && (mMouseHitTest.mLineNo != mVirtualCurrentRow)) {
+				mVirtualCurrentRow = mMouseHitTest.mLineNo;
+				invalidateOwn(NULL);
+				
+				EXTfldval	evParam[1];
+				evParam[0].setLong(mVirtualCurrentRow);
+				sendEvent(oDL_evClick, evParam, 1);
+			};
+			
+			return false;
+		};
+		
 		// we must also update our list pointed to by $dataname. Note that if we're dealing with an item reference we'll be updating the same list twice..
 		mOmnisList = getNamedList(mListName, pECI);
 		
 		qlong	currentLine = mOmnisList->getCurRow();
-		qlong	rowCnt = mOmnisList->rowCnt();
 		qlong	newCurrentLine = 0;
 		bool	selectionChanged = false;
 		
@@ -1602,20 +3478,16 @@ bool	oDataList::evMouseRDown(qpoint pDownAt, EXTCompInfo* pECI) {
 			newCurrentLine = mMouseHitTest.mLineNo;
 		};
 		
-		if (newCurrentLine > 0 && mOmnisList->isRowSelected(newCurrentLine, qfalse)) {
+		loadSelection();
+		if (newCurrentLine > 0 && mSelection.isSelected(newCurrentLine)) {
 			// The line we clicked on is marked as selected? Then we keep the selection as is.
 		} else {
-			for (qlong row = 1; row<=rowCnt; row++) {
-				if (row == newCurrentLine) {
-					if (!mOmnisList->isRowSelected(row, qfalse)) {
-						selectionChanged = true;
-						mOmnisList->selectRow(row, qtrue, qfalse);
-					};
-				} else if (mOmnisList->isRowSelected(row, qfalse)) {
-					selectionChanged = true;
-					mOmnisList->selectRow(row, qfalse, qfalse);
-				};
-			};		
+			// select only the line we clicked on, only the lines that change are updated
+			mSelection.selectAll(false);
+			if (newCurrentLine > 0) {
+				mSelection.select(newCurrentLine, true);
+			};
+			selectionChanged = mSelection.push(mOmnisList) > 0;
 		}
 		
 		// We do make sure regardless that the line we clicked on is the current line
@@ -1631,12 +3503,12 @@ bool	oDataList::evMouseRDown(qpoint pDownAt, EXTCompInfo* pECI) {
 		
 		if (selectionChanged) {
 			// Redraw
-			WNDinvalidateRect(mHWnd, NULL);
+			invalidateOwn(NULL);
 			
 			// let user know we changed our selection by simulating a click on a line
 			EXTfldval	evParam[1];
 			evParam[0].setLong(newCurrentLine);
-			ECOsendEvent(mHWnd, oDL_evClick, evParam, 1, EEN_EXEC_IMMEDIATE);				
+			sendEvent(oDL_evClick, evParam, 1);				
 		};
 	};
 
@@ -1650,6 +3522,8 @@ bool	oDataList::evMouseRDown(qpoint pDownAt, EXTCompInfo* pECI) {
 
 // let us know a key was pressed. Return true if Omnis should not do anything with this keypress
 bool	oDataList::evKeyPressed(qkey *pKey, bool pDown, EXTCompInfo* pECI) {
+	mPrefetchLines.clear(); // the user needs us, stop prefetching
+	
 	bool enabled = (isEnabled() && isActive() && ECOisOMNISinTrueRuntime(mHWnd));
 	if (enabled && ECOhasFocus(mHWnd)) {
 		pchar	testchar = pKey->getPChar();
@@ -1660,11 +3534,9 @@ bool	oDataList::evKeyPressed(qkey *pKey, bool pDown, EXTCompInfo* pECI) {
 
 			
 			if (mOmnisList != NULL) {
-				qlong	rowCnt = mOmnisList->rowCnt();
-				
-				for (qlong row = 1; row<=rowCnt; row++) {
-					mOmnisList->selectRow(row, qtrue, qfalse);
-				};				
+				loadSelection();
+				mSelection.selectAll(true);
+				mSelection.push(mOmnisList);
 				
                 // and select our first line
                 mOmnisList->setCurRow(1);
@@ -1674,12 +3546,48 @@ bool	oDataList::evKeyPressed(qkey *pKey, bool pDown, EXTCompInfo* pECI) {
 			};
 			
 			// and redraw
-			WNDinvalidateRect(mHWnd, NULL);
+			invalidateOwn(NULL);
             
             // and finally treat this as a click
 			EXTfldval	evParam[1];
 			evParam[0].setLong(1);
-			ECOsendEvent(mHWnd, oDL_evClick, evParam, 1, EEN_EXEC_IMMEDIATE);
+			sendEvent(oDL_evClick, evParam, 1);
+			
+			return true;
+		} else if (pDown && pKey->isVChar()) {
+			// arrow keys and friends move our current line
+			return navigateByKey(pKey, pECI);
+		} else if (pDown && (testchar >= ' ') && (!pKey->isControl()) && (!pKey->isAlt()) && (mVirtualRowCount == 0)) {
+			// type-ahead, keys typed in quick succession build up our prefix
+			qulong	now = oThread::milliseconds();
+			
+			if (now - mTypeAheadAt > 1000) {
+				mTypeAhead.clear();
+			};
+			mTypeAheadAt = now;
+			mTypeAhead += (qchar) testchar;
+			oDLNode::foldKey(mTypeAhead);
+			
+			mOmnisList = getNamedList(mListName, pECI);
+			if (mOmnisList != NULL) {
+				// as we type more characters our current line may still match
+				qlong	to = findVisiblePrefix(pECI, mTypeAhead, 1, mTypeAhead.length() > 1);
+				qlong	from = isLineVisible(mOmnisList->getCurRow()) ? mVisibleIndex[mOmnisList->getCurRow()] : -1;
+				
+				if ((to >= 0) && (to != from)) {
+					qlong	newRow = moveToVisibleIndex(from, to, false);
+					
+					delete mOmnisList;
+					mOmnisList = 0;
+					
+					EXTfldval	evParam[1];
+					evParam[0].setLong(newRow);
+					sendEvent(oDL_evClick, evParam, 1);
+				} else {
+					delete mOmnisList;
+					mOmnisList = 0;
+				};
+			};
 			
 			return true;
 		} else {
@@ -1690,6 +3598,396 @@ bool	oDataList::evKeyPressed(qkey *pKey, bool pDown, EXTCompInfo* pECI) {
 	};
 };
 
+// Find the nearest line in our flattened index starting at pIndex in the direction of pStep, if there is none we look the other way
+qlong	oDataList::findLineIndex(qlong pIndex, qlong pStep) {
+	qlong	count = mVisibleNodes.size();
+	
+	pIndex = pIndex < 0 ? 0 : (pIndex >= count ? count - 1 : pIndex);
+	for (qlong index = pIndex; (index >= 0) && (index < count); index += pStep) {
+		if (mVisibleNodes[index].mNode->lineNo() > 0) {
+			return index;
+		};
+	};
+	for (qlong index = pIndex - pStep; (index >= 0) && (index < count); index -= pStep) {
+		if (mVisibleNodes[index].mNode->lineNo() > 0) {
+			return index;
+		};
+	};
+	
+	return -1;
+};
+
+// Index of the first node we show at the top of our list in our flattened index, our list line numbers only increase
+qlong	oDataList::firstVisibleIndex(void) {
+	qlong	first = 0;
+	qlong	last = mVisibleNodes.size();
+	
+	while (first < last) {
+		qlong	middle = (first + last) / 2;
+		if (mVisibleNodes[middle].mListLineNo <= mVertScrollPos) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		};
+	};
+	
+	return first;
+};
+
+// Height of a node we're not drawing, rows use the heights we measured for the columns that extend them and otherwise count as a single line
+qdim	oDataList::estimateNodeHeight(oDLNode & pNode, qdim pIndent) {
+	qdim	height = mCanvas->getFontHeight();
+	
+	if (pNode.lineNo() != 0) {
+		for (qulong i = 0; (i < mColumnCount) && (i < 256); i++) {
+			qdim	columnHeight;
+			
+			if (mColumnExtend[i] && getCachedColumnHeight(pNode.lineNo(), i, getColumnTextWidth(i, pIndent), columnHeight) && (columnHeight > height)) {
+				height = columnHeight;
+			};
+		};
+	};
+	
+	if (height > mMaxRowHeight) {
+		height = mMaxRowHeight;
+	};
+	
+	// same spacing drawNode adds
+	return 2 + height + mLineSpacing;
+};
+
+// Scroll so we're pPixels down from the top of our list, we keep our position as the line at the top and how far it is scrolled up
+// so our position stays put when the heights we estimated for lines above it change
+void	oDataList::setSmoothScrollPos(qdim pPixels) {
+	qlong	first = 0;
+	qlong	last = mVisibleNodes.size();
+	
+	pPixels = pPixels > 0 ? pPixels : 0;
+	
+	// find the last node that starts at or above pPixels
+	while (first < last) {
+		qlong	middle = (first + last) / 2;
+		if (mVisibleNodes[middle].mOffset <= pPixels) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		};
+	};
+	
+	if (first == 0) {
+		mVertScrollPos		= 0;
+		mVertScrollOffset	= 0;
+	} else {
+		mVertScrollPos		= mVisibleNodes[first - 1].mListLineNo - 1;
+		mVertScrollOffset	= pPixels - mVisibleNodes[first - 1].mOffset;
+	};
+};
+
+// Invalidate the rows of our visible nodes from pFrom up to and including pTo
+void	oDataList::invalidateNodes(qlong pFrom, qlong pTo) {
+	qlong	first = pFrom < pTo ? pFrom : pTo;
+	qlong	last = pFrom < pTo ? pTo : pFrom;
+	qrect	rect = mClientRect;
+	
+	first = first < 0 ? 0 : first;
+	if ((last < first) || (last >= (qlong) mVisibleNodes.size())) {
+		return;
+	};
+	
+	rect.top	= mVisibleNodes[first].mTop;
+	rect.bottom	= mVisibleNodes[last].mRowBottom;
+	invalidateOwn(&rect);
+};
+
+// Scroll so this list line is on screen, returns true if we had to scroll
+bool	oDataList::scrollToListLine(qlong pListLineNo, qlong pLastVisible) {
+	qlong	newScrollPos = mVertScrollPos;
+	
+	if (pListLineNo <= mVertScrollPos) {
+		newScrollPos = pListLineNo - 1;
+	} else if (pListLineNo > pLastVisible) {
+		newScrollPos = mVertScrollPos + (pListLineNo - pLastVisible);
+	};
+	newScrollPos = newScrollPos > 0 ? newScrollPos : 0;
+	
+	if (newScrollPos == mVertScrollPos) {
+		return false;
+	};
+	
+	mVertScrollPos = newScrollPos;
+	mVertScrollOffset = 0;
+	if (!mSmoothScroll) {
+		// when smooth scrolling our next paint works out where our scrollbar should be
+		WNDsetScrollPos(mHWnd, SB_VERT, mVertScrollPos, qtrue);
+	};
+	invalidateOwn(NULL);
+	
+	return true;
+};
+
+// Move our current line using the keyboard, returns true if we handled the key
+bool	oDataList::navigateByKey(qkey *pKey, EXTCompInfo* pECI) {
+	qshort	key = pKey->getVChar();
+	bool	extend = pKey->isShift() && mShowSelected;
+	qlong	pageRows = mLastVisListNo - mVertScrollPos - 1;
+	
+	pageRows = pageRows > 1 ? pageRows : 1;
+	
+	if (mVirtualRowCount > 0) {
+		// in virtual mode our rows are our index
+		qlong	row = mVirtualCurrentRow;
+		
+		switch (key) {
+			case vcUp:		row--;					break;
+			case vcDown:	row++;					break;
+			case vcPup:		row -= pageRows;		break;
+			case vcPdown:	row += pageRows;		break;
+			case vcHome:	row = 1;				break;
+			case vcEnd:		row = mVirtualRowCount;	break;
+			default:
+				return false;
+				break;
+		};
+		row = row < 1 ? 1 : (row > mVirtualRowCount ? mVirtualRowCount : row);
+		
+		if (row != mVirtualCurrentRow) {
+			qlong	oldRow = mVirtualCurrentRow;
+			
+			mVirtualCurrentRow = row;
+			if (!scrollToListLine(row, mLastVisListNo)) {
+				// only redraw our old and new row
+				for (qlong index = 0; index < (qlong) mVirtualRowBottoms.size(); index++) {
+					qlong	drawnRow = mVertScrollPos + 1 + index;
+					
+					if ((drawnRow == oldRow) || (drawnRow == row)) {
+						qrect	rect = mClientRect;
+						rect.top	= index == 0 ? 0 : mVirtualRowBottoms[index - 1];
+						rect.bottom	= mVirtualRowBottoms[index];
+						invalidateOwn(&rect);
+					};
+				};
+			};
+			
+			EXTfldval	evParam[1];
+			evParam[0].setLong(row);
+			sendEvent(oDL_evClick, evParam, 1);
+		};
+		
+		return true;
+	};
+	
+	if (mVisibleNodes.size() == 0) {
+		return false;
+	};
+	
+	mOmnisList = getNamedList(mListName, pECI);
+	if (mOmnisList == NULL) {
+		return false;
+	};
+	
+	qlong	currentRow = mOmnisList->getCurRow();
+	qlong	count = mVisibleNodes.size();
+	qlong	from = isLineVisible(currentRow) ? mVisibleIndex[currentRow] : (mNavIndex < count ? mNavIndex : count - 1);
+	qlong	to = -1;
+	
+	switch (key) {
+		case vcUp:
+			to = findLineIndex(from - 1, -1);
+			break;
+		case vcDown:
+			to = findLineIndex(from + 1, 1);
+			break;
+		case vcPup:
+			to = findLineIndex(from - pageRows, -1);
+			break;
+		case vcPdown:
+			to = findLineIndex(from + pageRows, 1);
+			break;
+		case vcHome:
+			to = findLineIndex(0, 1);
+			break;
+		case vcEnd:
+			to = findLineIndex(count - 1, -1);
+			break;
+		case vcLeft:
+		case vcRight: {
+			if (from < 0) {
+				break;
+			};
+			
+			oDLNode *	node = mVisibleNodes[from].mNode;
+			bool		expand = key == vcRight;
+			
+			if ((node->childNodeCount() > 0) && (isNodeExpanded(node) != expand)) {
+				// collapse or expand our current node, everything below it moves
+				setNodeExpanded(node, expand);
+				mNavIndex = from;
+				invalidateOwn(NULL);
+			} else if (expand) {
+				// already expanded, move into our first child
+				if (node->childNodeCount() > 0) {
+					to = findLineIndex(from + 1, 1);
+				};
+			} else if (mVisibleNodes[from].mParent >= 0) {
+				qlong	parent = mVisibleNodes[from].mParent;
+				
+				if (mVisibleNodes[parent].mNode->lineNo() > 0) {
+					// move to our parent line
+					to = parent;
+				} else {
+					// our parent is a group, collapse it
+					setNodeExpanded(mVisibleNodes[parent].mNode, false);
+					mNavIndex = parent;
+					invalidateOwn(NULL);
+				};
+			};
+		}; break;
+		default:
+			delete mOmnisList;
+			mOmnisList = 0;
+			return false;
+			break;
+	};
+	
+	if ((to >= 0) && (to != from)) {
+		qlong	newRow = moveToVisibleIndex(from, to, extend);
+		
+		delete mOmnisList;
+		mOmnisList = 0;
+		
+		EXTfldval	evParam[1];
+		evParam[0].setLong(newRow);
+		sendEvent(oDL_evClick, evParam, 1);
+	} else {
+		delete mOmnisList;
+		mOmnisList = 0;
+	};
+	
+	return true;
+};
+
+// Make the line at pTo in our flattened index current and selected, scroll to it and redraw what changed, returns its line number. mOmnisList must be set
+qlong	oDataList::moveToVisibleIndex(qlong pFrom, qlong pTo, bool pExtend) {
+	qlong	newRow = mVisibleNodes[pTo].mNode->lineNo();
+	qlong	updated;
+	
+	loadSelection();
+	if (pExtend && (pFrom >= 0)) {
+		// select the visible lines between our old and new line
+		qlong	first = pFrom < pTo ? pFrom : pTo;
+		qlong	last = pFrom < pTo ? pTo : pFrom;
+		for (qlong index = first; index <= last; index++) {
+			if (mVisibleNodes[index].mNode->lineNo() > 0) {
+				mSelection.select(mVisibleNodes[index].mNode->lineNo(), true);
+			};
+		};
+	} else {
+		mSelection.selectAll(false);
+		mSelection.select(newRow, true);
+	};
+	updated = mSelection.push(mOmnisList);
+	mOmnisList->setCurRow(newRow);
+	mNavIndex = pTo;
+	
+	// we've dealt with scrolling, no need to recenter on our current line in doPaint
+	mLastCurrentLineTop = mVisibleNodes[pTo].mListLineNo;
+	if (scrollToListLine(mVisibleNodes[pTo].mListLineNo, mLastVisListNo)) {
+		// already redrawing everything
+	} else if (pExtend || (updated <= 2)) {
+		// only redraw the rows that changed
+		if (pExtend || (pFrom < 0)) {
+			invalidateNodes(pFrom < 0 ? pTo : pFrom, pTo);
+		} else {
+			invalidateNodes(pFrom, pFrom);
+			invalidateNodes(pTo, pTo);
+		};
+	} else {
+		// lines we can't see were deselected too
+		invalidateOwn(NULL);
+	};
+	
+	return newRow;
+};
+
+// Find the next visible line whose display value in pColumn starts with pPrefix, pPrefix must be folded. mOmnisList must be set. Returns the index in our flattened index or -1
+qlong	oDataList::findVisiblePrefix(EXTCompInfo* pECI, const oDLKey & pPrefix, qulong pColumn, bool pIncludeCurrent) {
+	qlong	rowCount = mOmnisList->rowCnt();
+	
+	if ((pColumn < 1) || (pColumn > mColumnCount) || (mVisibleNodes.size() == 0)) {
+		return -1;
+	};
+	
+	if (!mPrefixIndex.isBuiltFor(pColumn, rowCount)) {
+		// build our index, this evaluates our column for each line once, we compile our column once for all lines
+		qlong			oldCurRow = mOmnisList->getCurRow();
+		sDLPaintColumn	column;
+		
+		compileColumn(pECI, pColumn - 1, column);
+		mPrefixIndex.start(pColumn, rowCount);
+		for (qlong line = 1; line <= rowCount; line++) {
+			qstring	text;
+			
+			mOmnisList->setCurRow(line);
+			evalColumn(pECI, mOmnisList, line, pColumn - 1, column, text);
+			mPrefixIndex.add(text, line);
+		};
+		mPrefixIndex.finish();
+		if (column.mCalc != NULL) {
+			delete column.mCalc;
+		};
+		
+		mOmnisList->setCurRow(oldCurRow);
+	};
+	
+	// find the first match after our current line, or the first match if there is none
+	qlong	currentRow = mOmnisList->getCurRow();
+	qlong	current = isLineVisible(currentRow) ? mVisibleIndex[currentRow] : -1;
+	qlong	firstIndex = -1;
+	qlong	nextIndex = -1;
+	size_t	first, last;
+	
+	mPrefixIndex.findRange(pPrefix, first, last);
+	for (size_t entry = first; entry < last; entry++) {
+		qlong	line = mPrefixIndex.lineAt(entry);
+		
+		if (isLineVisible(line)) {
+			qlong	index = mVisibleIndex[line];
+			
+			if ((firstIndex == -1) || (index < firstIndex)) {
+				firstIndex = index;
+			};
+			if (((index > current) || (pIncludeCurrent && (index == current))) && ((nextIndex == -1) || (index < nextIndex))) {
+				nextIndex = index;
+			};
+		};
+	};
+	
+	return nextIndex != -1 ? nextIndex : firstIndex;
+};
+
+// Redraw after a change our event handlers made that doesn't change our list data, so our next paint doesn't need to snapshot our list again
+void	oDataList::invalidateOwn(qrect * pRect) {
+	mOwnPaint = true;
+	WNDinvalidateRect(mHWnd, pRect);
+};
+
+// Send an event to Omnis and run it right away, the code handling it may change our list
+void	oDataList::sendEvent(qlong pEvent, EXTfldval * pParams, qshort pParamCount) {
+	ECOsendEvent(mHWnd, pEvent, pParams, pParamCount, EEN_EXEC_IMMEDIATE);
+	
+	// so whatever we redraw next may no longer be just our own change
+	mOwnPaint = false;
+	mSelectionStale = true;
+};
+
+// Load mSelection from our list if it may have changed since we last did, the selections we make ourselves we push from mSelection so it stays up to date
+void	oDataList::loadSelection(void) {
+	if (mSelectionStale || (mSelection.rowCount() != mOmnisList->rowCnt())) {
+		mSelection.load(mOmnisList);
+		mSelectionStale = false;
+	};
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // drag and drop
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
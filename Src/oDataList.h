@@ -17,6 +17,11 @@
 
 #include "omnis.xcomp.framework.h"
 #include "oDLNode.h"
+#include "oThread.h"
+#include <map>
+#include <set>
+
+#define ODL_IDLEINTERVAL	50		// milliseconds between calls to idleTimer
 
 enum oDataListPropIDs {
 	oDL_columncount		= 100,
@@ -33,6 +38,16 @@ enum oDataListPropIDs {
 	oDL_filtercalc		= 122,
 	oDL_deselNodeClick	= 123,
 	oDL_parentCalcs		= 124,
+	oDL_idColumn		= 125,
+	oDL_parentIdColumn	= 126,
+	oDL_sortColumns		= 127,
+	oDL_groupColumns	= 128,
+	oDL_asyncRebuild	= 129,
+	oDL_virtualRows		= 130,
+	oDL_virtualWindow	= 131,
+	oDL_sharedTree		= 132,
+	oDL_prefetchRows	= 133,
+	oDL_smoothScroll	= 134,
 };
 
 enum oDataListEventIDs {
@@ -41,6 +56,13 @@ enum oDataListEventIDs {
 	oDL_evVScrolled		= 102,
 	oDL_evColumnResized	= 103,
 	oDL_evDoubleClick	= 104,
+	oDL_evRebuilt		= 105,
+	oDL_evNeedRows		= 106,
+};
+
+enum oDataListState {
+	oDL_stateMagic		= 0x534C446F,	// "oDLS"
+	oDL_stateVersion	= 2,
 };
 
 enum oDataListHittest {
@@ -54,6 +76,55 @@ typedef struct sDLHitTest {
 	qlong				mLineNo;
 } sDLHitTest;
 
+typedef struct sDLRebuildJob {
+	sDLSnapshot			mSnapshot;		// copy of the list data we're building our tree from
+	bool				mAdjacency;		// build using our id/parent id columns instead of grouping
+	oDLNode				mRoot;			// the tree we're building
+	qlong				mCycles;		// cycles we had to break in our parent ids
+	oAtomic				mCancel;		// set to 1 when a newer rebuild supersedes us
+	oAtomic				mDone;			// set to 1 when our tree is ready
+	oAtomic				mProgress;		// number of lines processed so far
+	oThread				mThread;		// our background thread
+} sDLRebuildJob;
+
+typedef struct sDLGroupRange {
+	const sDLSnapshot *	mSnapshot;		// snapshot we're grouping
+	qlong				mFrom;			// first line in our snapshot we group
+	qlong				mTo;			// line after the last line we group
+	oDLGroupBucket *	mBucket;		// bucket we group into
+	oAtomic *			mCancel;		// set to 1 if we're no longer needed, may be NULL
+	oAtomic *			mProgress;		// progress we add to, may be NULL
+} sDLGroupRange;
+
+typedef struct sDLVisibleNode {
+	oDLNode *			mNode;			// the node we drew
+	qlong				mParent;		// index of our parent in our flattened index, -1 for top level nodes
+	qlong				mListLineNo;	// list line number we drew this node as
+	qdim				mTop;			// top of our node
+	qdim				mRowBottom;		// bottom of our own row, equal to mTop if we're off screen
+	qdim				mBottom;		// bottom of our node including its children
+	qdim				mOffset;		// top of our node in pixels if we weren't scrolled, only kept when smooth scrolling
+	qrect				mTreeIconRect;	// our tree icon before horizontal scrolling
+	qdim				mIndent;		// indent we drew our node with
+	bool				mIsEven;		// if true we drew our node with our even color
+} sDLVisibleNode;
+
+typedef struct sDLCellHeight {
+	qdim				mWidth;			// width we wrapped our text in
+	qdim				mHeight;		// height of our text
+} sDLCellHeight;
+
+typedef struct sDLPrefetchLine {
+	qlong				mLineNo;		// line we want to evaluate and measure
+	qdim				mIndent;		// indent we draw this line with
+} sDLPrefetchLine;
+
+typedef struct sDLPaintColumn {
+	bool				mChecked;		// if true we've looked at this column during this paint
+	bool				mDirect;		// if true we show our list column as is
+	EXTfldval *			mCalc;			// our compiled calculation, NULL if we show our list column or our calculation failed to compile
+} sDLPaintColumn;
+
 typedef struct sDLGrouping {
 	qstring *			mGroupCalc;		// group calculation
 	qstring *			mParentCalc;	// parent calculation
@@ -62,6 +133,40 @@ typedef struct sDLGrouping {
 class oDataList : public oBaseVisComponent {
 private:
 	bool						mRebuildNodes;														// if true we need to rebuild our nodes
+	bool						mAsyncRebuild;														// if true we rebuild our nodes on a background thread when we can
+	unsigned long long			mAsyncFingerprint;													// fingerprint of the data our last background rebuild was started for
+	qlong						mAsyncRowCount;														// number of lines in our list when we took the snapshot for our last background rebuild
+	bool						mOwnPaint;															// if true we're repainting after a change our own event handlers made, our list data hasn't changed
+	sDLRebuildJob *				mRebuildJob;														// our background rebuild, if one is running
+	oTimer						mIdleTimer;															// calls idleTimer while we wait on our background rebuild or have rows to prefetch
+	
+	qlong						mVirtualRowCount;													// if not 0 we're in virtual mode and this is the number of rows we have
+	qlong						mVirtualWindow;														// number of rows we keep cached around our visible rows in virtual mode
+	qlong						mVirtualCurrentRow;													// our current row in virtual mode
+	oDLRowCache					mRowCache;															// rows Omnis gave us in virtual mode
+	std::vector<qdim>			mVirtualRowBottoms;													// bottom of each row we drew in virtual mode
+	
+	std::map<unsigned long long, sDLCellHeight>	mCellHeights;									// heights we measured for columns that extend our row height, so we don't need to evaluate them while off screen
+	bool						mScrollOnlyPaint;													// if true we're repainting because we scrolled and can trust mCellHeights
+	std::map<unsigned long long, qstring>	mCellTexts;											// texts we evaluated for our columns, valid as long as mCellHeights is
+	qlong						mPrefetchRows;														// number of rows above and below our visible rows we evaluate and measure while idle, 0 if we don't
+	std::vector<sDLPrefetchLine>	mPrefetchLines;													// lines we still want to prefetch, the next one is at the back
+	bool						mPrefetchPaint;														// if true we're repainting to continue our prefetch
+	
+	bool						mPainting;															// if true we're inside doPaint and keep our compiled column calculations in mPaintColumns
+	std::vector<sDLPaintColumn>	mPaintColumns;														// column calculations we compiled during this paint, freed when we're done painting
+	std::vector<const qstring *>	mRowTexts;														// scratch buffer with the text of each column of the row we're drawing, NULL if we don't have it
+	qlong						mPaintCacheMisses;													// number of times during our last paint we had to compute or grow something we'd rather reuse
+	qlong						mPaintRows;															// number of rows we drew during our last paint
+	qlong						mPaintTime;															// time our last paint took in milliseconds
+	qlong						mListLineCount;														// number of list lines we counted when we last walked our tree
+	
+	bool						mSmoothScroll;														// if true we scroll vertically by pixel instead of by line
+	qdim						mVertScrollOffset;													// number of pixels our first visible line is scrolled up by when smooth scrolling
+	qdim						mContentHeight;														// height of all our visible nodes when smooth scrolling, using estimates for those we haven't drawn
+	qdim						mRowEstimate;														// height of a single line row as of our last paint
+	unsigned long long			mStateFingerprint;													// fingerprint of the data and settings of the state we restored with $loadstate, 0 if we haven't or we've since redrawn for anything but scrolling
+	qlong						mStateRowCount;														// number of lines in our list when we restored our state
 
 	bool						mShowSelected;														// if true we show selected lines, if false we only show the current line
 	qdim						mIndent;															// Indent for our tree
@@ -72,6 +177,9 @@ private:
 	bool						mDeselectOnNodeClick;												// Deselect lines when the user clicks on a node
 	qlong						mParentGrouping;													// Group that can also be a line
 	qstring						mParentCalculation;													// If this calculation returns true, the line is our parent line
+	qlong						mIdColumn;															// Column containing the id of a line, if set together with mParentIdColumn we build our tree from these
+	qlong						mParentIdColumn;													// Column containing the id of the parent line
+	std::vector<qlong>			mGroupColumns;														// Columns we group on, used instead of our group calculations if set
 	
 	qulong						mColumnCount;														// Number of columns we are displaying
 	qArray<qstring *>			mColumnCalculations;												// Calculations for displaying our column data
@@ -84,8 +192,22 @@ private:
 	qcol						mSelectColor;														// Background color for selected lines
 	
 	qstring						mFilter;															// Our filter
+	oDLSortKeys					mSortKeys;															// Columns we sort our nodes on and the keys we extracted for them
 
 	oDLNode						mRootNode;															// Our root node
+	bool						mSharedTree;														// if true we share our tree with other data lists showing the same data with the same settings
+	oDLSharedModel *			mSharedModel;														// the tree we share, if set we draw this instead of mRootNode
+	qlong						mSharedRowCount;													// number of lines in our list when we last built or found our shared tree
+	std::set<const oDLNode *>	mCollapsedNodes;													// nodes in our shared tree we've collapsed, the nodes themselves are shared
+	std::vector<sDLVisibleNode>	mVisibleNodes;														// Our visible nodes in the order we drew them with where we drew them, rebuilt when we draw
+	std::vector<qlong>			mVisibleIndex;														// Index into mVisibleNodes for each line in our list, -1 if that line isn't visible
+	qlong						mDrawParentIndex;													// Index of the parent of the node we're drawing while building our index
+	qlong						mNavIndex;															// Index into mVisibleNodes we last moved to with the keyboard, used if our current line isn't visible
+	oDLSelection				mSelection;															// Selection state of our list
+	bool						mSelectionStale;													// if true our list may have changed since we loaded mSelection
+	oDLPrefixIndex				mPrefixIndex;														// Index over the display values of a column for finding lines by prefix
+	oDLKey						mTypeAhead;															// Prefix the user has typed so far
+	qulong						mTypeAheadAt;														// When the user typed the last character of our prefix, see oThread::milliseconds
     bool                        mCheckedDataName;                                                   // check if we've attempted to convert our dataname
     qstring                     mListName;                                                          // Contents of $listname
 	EXTqlist *					mOmnisList;															// List pointed to by $listname (only set during events)
@@ -98,9 +220,68 @@ private:
 	void						clearColumnCalcs(void);												// Clear our column calculations
 	
 	void						checkColumns(void);													// Check if our column data is complete
+	void						buildGroupedNodes(EXTCompInfo* pECI, qlong pRowCount);				// Rebuild our nodes using our group calculations
+	void						takeSnapshot(EXTCompInfo* pECI, qlong pRowCount, const std::vector<qlong> & pColumns, sDLSnapshot & pSnapshot);	// Take a snapshot of the lines that pass our filter and the values in the given columns
+	void						clearVisibleIndex(void);											// Clear our flattened index of visible nodes
+	oDLNode &					rootNode(void);														// The tree we're showing
+	bool						isNodeExpanded(oDLNode * pNode);									// Is this node expanded?
+	void						setNodeExpanded(oDLNode * pNode, bool pExpanded);					// Expand or collapse this node
+	void						carryCollapsed(oDLNode & pOld, oDLNode & pNew, std::set<const oDLNode *> & pCollapsed);	// Find the nodes in pNew matching collapsed nodes in pOld
+	void						releaseSharedModel(void);											// Stop using a shared tree
+	void						buildSharedNodes(EXTCompInfo* pECI, qlong pRowCount);				// Build or find a tree we share with other data lists
+	bool						isLineVisible(qlong pLineNo);										// Is this line visible in our tree?
+	void						extendSelection(qlong pFrom, qlong pTo);							// Select or deselect the lines after pFrom up to pTo like pFrom
+	unsigned long long			stateFingerprint(EXTCompInfo* pECI, qlong pRowCount);				// Fingerprint of the contents of our list and the settings we build our tree with
+	void						saveNodeState(oDLStateStream & pStream, oDLNode & pNode);			// Write the child nodes of this node to our state
+	bool						loadNodeState(oDLStateStream & pStream, oDLNode & pNode);			// Read child nodes for this node from our state, returns false if our state is invalid
+	void						saveState(EXTCompInfo* pECI, EXTfldval & pState);					// Save our tree, expanded state, row heights and scroll position as a binary
+	bool						loadState(EXTCompInfo* pECI, EXTfldval & pState);					// Restore a state saved with saveState, returns false if it doesn't match our list
+	void						addTreeRows(EXTqlist * pList, oDLNode & pNode, qlong pLevel);		// Add a line to pList for each node below pNode
+	void						swapInNodes(oDLNode & pNewRoot);									// Swap in a newly built tree, carrying over the expanded state of our current nodes
+	void						buildAdjacencyNodes(EXTCompInfo* pECI, qlong pRowCount);			// Rebuild our nodes using our id and parent id columns
+	static qlong				buildAdjacencyTree(const sDLSnapshot & pSnapshot, oDLNode & pRoot, oAtomic * pCancel = NULL, oAtomic * pProgress = NULL);	// Build a tree from id/parent id pairs, returns the number of cycles we had to break
+	void						buildColumnGroupedNodes(EXTCompInfo* pECI, qlong pRowCount);		// Rebuild our nodes grouping on the values in our group columns
+	static void					groupSnapshotRange(void * pRange);									// Group a range of lines in our snapshot, this runs on a worker thread
+	static void					buildColumnGroupTree(const sDLSnapshot & pSnapshot, oDLNode & pRoot, oAtomic * pCancel = NULL, oAtomic * pProgress = NULL);	// Build a tree grouping the lines in our snapshot on its values
+	
+	void						startAsyncRebuild(EXTCompInfo* pECI, qlong pRowCount, bool pForce);	// Snapshot our list and rebuild our nodes on a background thread if our data changed
+	void						cancelAsyncRebuild(void);											// Cancel any rebuild running in the background
+	bool						checkAsyncRebuild(void);											// Swap in the result of our background rebuild if it has finished, returns true if we did
+	bool						startIdleTimer(void);												// Make sure mIdleTimer is running, returns false if we couldn't start it
+	static void					idleTimer(void * pList);											// Called by mIdleTimer in between handling messages while we wait on our background rebuild or have rows to prefetch
+	static void					runRebuildJob(void * pJob);											// Build the tree for our job, this runs on our background thread
 	qdim						drawDividers(qdim pTop, qdim pBottom);								// Draw divider lines
 	qdim						drawNode(EXTCompInfo* pECI, oDLNode &pNodeqdim, qdim pIndent, qdim pTop, qlong & pListLineNo, bool & pIsEven);	// Draw this node
+	qdim						drawNodeRow(EXTCompInfo* pECI, qlong pIndex, qdim pIndent, qdim pTop, bool pIsEven);	// Draw the row of a node in our flattened index, returns its height without spacing
+	void						redrawVisibleNodes(EXTCompInfo* pECI);								// Draw the rows we drew during our last paint again from our flattened index, without walking our tree
+	void						invalidateOwn(qrect * pRect);										// Redraw after a change our event handlers made that doesn't change our list data
+	void						sendEvent(qlong pEvent, EXTfldval * pParams, qshort pParamCount);	// Send an event to Omnis and run it right away
+	void						loadSelection(void);												// Load mSelection from our list if it may have changed since we last did, mOmnisList must be set
+	void						getColumnText(EXTCompInfo* pECI, EXTqlist * pList, qlong pLineNo, qulong pColumn, qstring & pText);	// Get the text for a column of a line in a list
+	void						compileColumn(EXTCompInfo* pECI, qulong pColumn, sDLPaintColumn & pCompiled);	// Compile the calculation for a column, the caller frees pCompiled.mCalc
+	void						evalColumn(EXTCompInfo* pECI, EXTqlist * pList, qlong pLineNo, qulong pColumn, const sDLPaintColumn & pCompiled, qstring & pText);	// Get the text for a column of a line with a compiled column
+	void						getVisibleColumns(qulong & pFirst, qulong & pLast);					// Find the columns that are visible after horizontal scrolling
+	qdim						getColumnTextWidth(qulong pColumn, qdim pIndent);					// Width we wrap the text of a column in
+	static unsigned long long	cellHeightKey(qlong pLineNo, qulong pColumn) { return (((unsigned long long) pLineNo) << 16) + pColumn; };	// Key into mCellHeights and mCellTexts
+	bool						getCachedColumnHeight(qlong pLineNo, qulong pColumn, qdim pWidth, qdim & pHeight);	// Get the height we measured before for the text in this column
+	const qstring &				getCachedColumnText(EXTCompInfo* pECI, qlong pLineNo, qulong pColumn);	// Get the text for a column of a line in our list, evaluating it only if we haven't before
+	void						clearPaintColumns(void);											// Free the calculations we compiled during our paint
+	void						queuePrefetch(void);												// Queue the rows around our visible rows for prefetching
+	bool						prefetchRows(EXTCompInfo* pECI);									// Evaluate and measure queued rows for a short while, returns true if there are rows left
 	qdim						drawRow(EXTCompInfo* pECI, qlong pLineNo, qdim pIndent, qdim pTop, bool pIsEven);	// Draw this row
+	qdim						drawRowData(qlong pLineNo, const std::vector<const qstring *> & pColumnData, qdim pIndent, qdim pTop, bool pIsSelected, bool pIsEven);	// Draw a row with the text for each column
+	void						drawVirtualRows(std::vector<qlong> & pNeedPages);					// Draw the rows visible in virtual mode from our row cache
+	void						setVirtualRows(EXTCompInfo* pECI, qlong pFrom, EXTqlist * pList);	// Copy rows Omnis gave us into our row cache
+	
+	qlong						findLineIndex(qlong pIndex, qlong pStep);							// Find the nearest line in our flattened index in the direction of pStep
+	qlong						firstVisibleIndex(void);											// Index of the first node we show at the top of our list in our flattened index
+	qdim						estimateNodeHeight(oDLNode & pNode, qdim pIndent);					// Height of a node we're not drawing, based on what we've measured before
+	void						setSmoothScrollPos(qdim pPixels);									// Scroll so we're pPixels down from the top of our list
+	void						invalidateNodes(qlong pFrom, qlong pTo);							// Invalidate the rows of our visible nodes from pFrom up to pTo
+	bool						scrollToListLine(qlong pListLineNo, qlong pLastVisible);			// Scroll so this list line is on screen, returns true if we had to scroll
+	bool						navigateByKey(qkey *pKey, EXTCompInfo* pECI);						// Move our current line using the keyboard, returns true if we handled the key
+	qlong						moveToVisibleIndex(qlong pFrom, qlong pTo, bool pExtend);			// Make the line at pTo in our flattened index current and selected, returns its line number
+	qlong						findVisiblePrefix(EXTCompInfo* pECI, const oDLKey & pPrefix, qulong pColumn, bool pIncludeCurrent);	// Find the next visible line whose display value starts with pPrefix
 	
 	void						clearHitTest(void);													// clear our hitttest info
 	sDLHitTest					doHitTest(qpoint pAt);												// find what we are above
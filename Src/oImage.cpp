@@ -10,6 +10,7 @@
 
 
 #include "oImage.h"
+#include <string.h>
 
 oImage::oImage(void) {
 	// by default we add an empty bitmap layer
@@ -21,6 +22,12 @@ oImage::oImage(void) {
 	mCachedHeight	= 0;
 	mImageWidth		= 0;
 	mImageHeight	= 0;
+	mMaxThreads		= 0;
+	mEncoded		= NULL;
+	mEncodedLen		= 0;
+	mEncodeCount	= 0;
+	mCompression	= oIMC_best;
+	mMaxDecodePixels = 64 * 1024 * 1024;
 };
 
 oImage::~oImage(void) {
@@ -49,14 +56,181 @@ void	oImage::copyObject(oBaseNVComponent *pCopy) {
 // cached image
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// our cached image changed, forget its encoded version
+void	oImage::clearEncoded() {
+	if (mEncoded != NULL) {
+		free(mEncoded);
+		mEncoded	= NULL;
+		mEncodedLen	= 0;
+	};
+};
+
+// return our image as PNG, encoding it only if it changed
+void	oImage::getEncodedImage(EXTfldval &pValue) {
+	// create our image based on the size of our first layer
+	updateCachedImg(mImageWidth, mImageHeight);
+	
+	if (mCachedImage == NULL) {
+		pValue.setEmpty(fftBinary, 0);
+	} else {
+		if (mEncoded == NULL) {
+			// addToTraceLog("Getting cached image as png");
+			mEncoded = oImgEncoder::encodePNG(mCachedImage->imagebuffer(), mCachedWidth, mCachedHeight, mCompression, mEncodedLen);
+			mEncodeCount++;
+		};
+
+		if (mEncoded!=NULL) {
+			pValue.setBinary(fftBinary, mEncoded, mEncodedLen);
+		} else {
+			pValue.setEmpty(fftBinary, 0);
+		};
+	};
+};
+
 // clear our cached image
 void	oImage::clearCachedImg() {
+	clearEncoded();
 	if (mCachedImage != NULL) {
 		delete mCachedImage;
 		mCachedImage	= NULL;
 		mCachedWidth	= 0;
 		mCachedHeight	= 0;
 	};
+	mDirty.clear();
+};
+
+// mark an area of our cached image as out of date
+void	oImage::markDirty(sImgRect pRect) {
+	if ((mCachedImage == NULL) || pRect.isEmpty()) {
+		// nothing to keep up to date
+		return;
+	};
+
+	// merge with any area we touch so we never composite the same pixels twice
+	qulong	rect = 0;
+	while (rect < mDirty.size()) {
+		if (mDirty[rect].touches(pRect)) {
+			if (mDirty[rect].mLeft < pRect.mLeft) pRect.mLeft = mDirty[rect].mLeft;
+			if (mDirty[rect].mTop < pRect.mTop) pRect.mTop = mDirty[rect].mTop;
+			if (mDirty[rect].mRight > pRect.mRight) pRect.mRight = mDirty[rect].mRight;
+			if (mDirty[rect].mBottom > pRect.mBottom) pRect.mBottom = mDirty[rect].mBottom;
+			mDirty.erase(mDirty.begin() + rect);
+
+			// our area grew, start over
+			rect = 0;
+		} else {
+			rect++;
+		};
+	};
+	mDirty.push_back(pRect);
+
+	if (mDirty.size() > 16) {
+		// too many little areas, just do one big one
+		sImgRect	area = mDirty[0];
+		for (rect = 1; rect < mDirty.size(); rect++) {
+			if (mDirty[rect].mLeft < area.mLeft) area.mLeft = mDirty[rect].mLeft;
+			if (mDirty[rect].mTop < area.mTop) area.mTop = mDirty[rect].mTop;
+			if (mDirty[rect].mRight > area.mRight) area.mRight = mDirty[rect].mRight;
+			if (mDirty[rect].mBottom > area.mBottom) area.mBottom = mDirty[rect].mBottom;
+		};
+		mDirty.clear();
+		mDirty.push_back(area);
+	};
+};
+
+// mark the area covered by this layer as out of date
+void	oImage::markLayerDirty(oImgLayer * pLayer) {
+	if (pLayer->enabled()) {
+		markDirty(pLayer->bounds());
+	};
+};
+
+// index of the first layer we draw, this one is copied instead of mixed
+qlong	oImage::firstEnabledLayer() {
+	for	(qulong layer = 0;layer < mLayers.size(); layer++) {
+		if (mLayers[layer]->enabled()) {
+			return layer;
+		};
+	};
+
+	return -1;
+};
+
+// recomposite this area of our cached image
+void	oImage::compositeRegion(sImgRect pRect) {
+	if (pRect.mLeft < 0) pRect.mLeft = 0;
+	if (pRect.mTop < 0) pRect.mTop = 0;
+	if (pRect.mRight > mCachedWidth) pRect.mRight = mCachedWidth;
+	if (pRect.mBottom > mCachedHeight) pRect.mBottom = mCachedHeight;
+	if (pRect.isEmpty()) {
+		return;
+	};
+
+	// our layers update their caches and do their checks here so they are only read while we composite
+	for	(qulong layer = 0;layer < mLayers.size(); layer++) {
+		if (mLayers[layer]->enabled()) {
+			mLayers[layer]->prepareLayer(*mCachedImage, pRect);
+		};
+	};
+
+	// only split up our work if there is enough of it to be worth starting threads for
+	qlong	rows	= pRect.mBottom - pRect.mTop;
+	qlong	pixels	= (pRect.mRight - pRect.mLeft) * rows;
+	qlong	threads	= mMaxThreads > 0 ? mMaxThreads : (qlong) oThread::hardwareConcurrency();
+	if (threads > (pixels / 262144)) threads = pixels / 262144;
+	if (threads > rows) threads = rows;
+	if (threads < 1) threads = 1;
+
+	// each thread composites its own band of rows, we do the first band ourselves
+	oThread *				workers = new oThread[threads];
+	std::vector<sImgBand>	bands(threads);
+	qlong					chunk = (rows + threads - 1) / threads;
+	for (qlong t = 0; t < threads; t++) {
+		bands[t].mImage			= this;
+		bands[t].mRect			= pRect;
+		bands[t].mRect.mTop		= pRect.mTop + (t * chunk) > pRect.mBottom ? pRect.mBottom : pRect.mTop + (t * chunk);
+		bands[t].mRect.mBottom	= bands[t].mRect.mTop + chunk > pRect.mBottom ? pRect.mBottom : bands[t].mRect.mTop + chunk;
+	};
+	for (qlong t = 1; t < threads; t++) {
+		if (!bands[t].mRect.isEmpty()) {
+			if (!workers[t].start(runCompositeBand, &bands[t])) {
+				// couldn't start a thread, composite this band ourselves
+				compositeBand(bands[t].mRect);
+			};
+		};
+	};
+
+	compositeBand(bands[0].mRect);
+
+	for (qlong t = 1; t < threads; t++) {
+		workers[t].join();
+	};
+	delete [] workers;
+};
+
+// entry point for our worker threads, pBand is a sImgBand
+void	oImage::runCompositeBand(void * pBand) {
+	sImgBand *	band = (sImgBand *) pBand;
+
+	band->mImage->compositeBand(band->mRect);
+};
+
+// recomposite a band of our cached image, called from our worker threads
+void	oImage::compositeBand(sImgRect pRect) {
+	// start with a transparent area
+	sPixel *	buffer = mCachedImage->imagebuffer();
+	for (qlong y = pRect.mTop; y < pRect.mBottom; y++) {
+		memset(buffer + (y * mCachedWidth) + pRect.mLeft, 0, sizeof(sPixel) * (pRect.mRight - pRect.mLeft));
+	};
+
+	// Apply our layers...
+	bool	mix = false;
+	for	(qulong layer = 0;layer < mLayers.size(); layer++) {
+		if (mLayers[layer]->enabled()) {
+			mLayers[layer]->drawLayer(*mCachedImage, mix, pRect);
+			mix = true;
+		};
+	};
 };
 
 // update our cached image
@@ -74,25 +248,25 @@ void	oImage::updateCachedImg(qdim pWidth, qdim pHeight) {
 		clearCachedImg();
 		
 		if ((pWidth!=0) && (pHeight!=0)) {
-			bool	mix = false;
-			
 			// addToTraceLog("Creating cached image: %li, %li", pWidth, pHeight);
 			mCachedImage = new oRGBAImage(pWidth, pHeight);
 			if (mCachedImage != NULL) {
 				mCachedWidth = pWidth;
 				mCachedHeight = pHeight;
 				
-				// Apply our layers...
-				for	(qulong layer = 0;layer < mLayers.size(); layer++) {
-					// addToTraceLog("Applying layer %li", layer+1);
-					if (mLayers[layer]->enabled()) {
-						mLayers[layer]->drawLayer(*mCachedImage, mix);
-						mix = true;
-					};
-				};				
+				sImgRect	all = { 0, 0, pWidth, pHeight };
+				compositeRegion(all);
 			};			
 		};
+	} else if ((mCachedImage != NULL) && (mDirty.size() > 0)) {
+		// only redo what has changed
+		clearEncoded();
+		for (qulong rect = 0; rect < mDirty.size(); rect++) {
+			compositeRegion(mDirty[rect]);
+		};
 	};
+
+	mDirty.clear();
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -109,6 +283,14 @@ ECOproperty oImageProperties[] = {
 														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
 	oIM_imageHeight,			4311,	fftInteger,		EXTD_FLAG_PROPDATA
 														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
+	oIM_maxthreads,				4313,	fftInteger,		EXTD_FLAG_PROPDATA
+														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
+	oIM_encodecount,			4314,	fftInteger,		EXTD_FLAG_PROPDATA
+														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
+	oIM_pngcompression,			4315,	fftInteger,		EXTD_FLAG_PROPDATA
+														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
+	oIM_maxdecodepixels,		4316,	fftInteger,		EXTD_FLAG_PROPDATA
+														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
 	oIM_currentlayer,			4301,	fftInteger,		EXTD_FLAG_PROPCUSTOM
 														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
 	oIM_layerenabled,			4308,	fftBoolean,		EXTD_FLAG_PROPCUSTOM
@@ -125,6 +307,10 @@ ECOproperty oImageProperties[] = {
 														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
 	oIM_layercontents,			4307,	fftBinary,		EXTD_FLAG_PROPCUSTOM
 														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
+	oIM_layerfilter,			4312,	fftInteger,		EXTD_FLAG_PROPCUSTOM
+														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
+	oIM_layerdecodescale,		4317,	fftInteger,		EXTD_FLAG_PROPCUSTOM
+														+EXTD_FLAG_RUNTIMEONLY,	0,		0,			0,
 };	
 
 
@@ -147,6 +333,9 @@ qbool	oImage::canAssign(qlong pPropID) {
 		case oIM_image:
 			return qfalse;
 			break;
+		case oIM_encodecount:
+			return qfalse;
+			break;
 		case oIM_layertype:
 			// read only for now..
 			return qfalse;
@@ -168,6 +357,10 @@ qbool	oImage::setProperty(qlong pPropID,EXTfldval &pNewValue,EXTCompInfo* pECI)
 			// read only
 			return qfalse;
 		}; break;
+		case oIM_encodecount: {
+			// read only
+			return qfalse;
+		}; break;
 		case oIM_imageWidth: {
 			mImageWidth = pNewValue.getLong();
 			clearCachedImg();
@@ -178,6 +371,24 @@ qbool	oImage::setProperty(qlong pPropID,EXTfldval &pNewValue,EXTCompInfo* pECI)
 			clearCachedImg();
 			return true;						
 		}; break;
+		case oIM_maxthreads: {
+			mMaxThreads = pNewValue.getLong();
+			if (mMaxThreads < 0) mMaxThreads = 0;
+			return true;
+		}; break;
+		case oIM_pngcompression: {
+			qlong	compression = pNewValue.getLong();
+			if ((compression >= oIMC_none) && (compression <= oIMC_best) && (compression != mCompression)) {
+				mCompression = compression;
+				clearEncoded();
+			};
+			return true;
+		}; break;
+		case oIM_maxdecodepixels: {
+			mMaxDecodePixels = pNewValue.getLong();
+			if (mMaxDecodePixels < 0) mMaxDecodePixels = 0;
+			return true;
+		}; break;
 		case oIM_currentlayer: {
 			qulong	newlayer = pNewValue.getLong();
 			if ((newlayer > 0) && (newlayer <= mLayers.size())) {
@@ -191,40 +402,64 @@ qbool	oImage::setProperty(qlong pPropID,EXTfldval &pNewValue,EXTCompInfo* pECI)
 		}; break;
 		case oIM_layerenabled: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			qlong		wasfirst = firstEnabledLayer();
+			markLayerDirty(layer);
 			layer->setEnabled(pNewValue.getBool()==2);
-			clearCachedImg();
+			markLayerDirty(layer);
+			if (firstEnabledLayer() != wasfirst) {
+				// a different layer is now copied instead of mixed
+				clearCachedImg();
+			};
 			return true;			
 		}; break;
 		case oIM_layerleft: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			markLayerDirty(layer);
 			layer->setLeft(pNewValue.getLong());
-			clearCachedImg();
+			markLayerDirty(layer);
 			return true;
 		}; break;
 		case oIM_layertop: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			markLayerDirty(layer);
 			layer->setTop(pNewValue.getLong());
-			clearCachedImg();
+			markLayerDirty(layer);
 			return true;
 		}; break;
 		case oIM_layerwidth: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			markLayerDirty(layer);
 			layer->setWidth(pNewValue.getLong());
-			clearCachedImg();
+			markLayerDirty(layer);
 			return true;
 		}; break;
 		case oIM_layerheight: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			markLayerDirty(layer);
 			layer->setHeight(pNewValue.getLong());
-			clearCachedImg();
+			markLayerDirty(layer);
 			return true;
 		}; break;
 		case oIM_layercontents: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
-			layer->setContents(pNewValue);
-			clearCachedImg();
+			markLayerDirty(layer);
+			layer->setContents(pNewValue, mMaxDecodePixels);
+			markLayerDirty(layer);
 			return true;			
 		}; break;
+		case oIM_layerdecodescale: {
+			// only applies to contents assigned after this
+			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			layer->setDecodeScale(pNewValue.getLong());
+			return true;
+		}; break;
+		case oIM_layerfilter: {
+			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			markLayerDirty(layer);
+			layer->setFilter(pNewValue.getLong());
+			markLayerDirty(layer);
+			return true;
+		}; break;
 		default:
 			return oBaseNVComponent::setProperty(pPropID, pNewValue, pECI);
 			break;
@@ -240,26 +475,7 @@ qbool oImage::getProperty(qlong pPropID,EXTfldval &pGetValue,EXTCompInfo* pECI)
             return true;
 		}; break;
 		case oIM_image: {
-			// create our image based on the size of our first layer
-			updateCachedImg(mImageWidth, mImageHeight);
-			
-			if (mCachedImage == NULL) {
-				pGetValue.setEmpty(fftBinary, 0);
-			} else {
-				// addToTraceLog("Getting cached image as png");
-
-				int len;
-				unsigned char * pngdata = mCachedImage->asPNG(len);
-
-				if (pngdata!=NULL) {
-					pGetValue.setBinary(fftBinary, pngdata, len);
-
-					// and free up our memory
-					free(pngdata);
-				} else {
-					pGetValue.setEmpty(fftBinary, 0);
-				};
-			};
+			getEncodedImage(pGetValue);
             return true;
 		}; break;
 		case oIM_imageWidth: {
@@ -268,6 +484,27 @@ qbool oImage::getProperty(qlong pPropID,EXTfldval &pGetValue,EXTCompInfo* pECI)
 		}; break;
 		case oIM_imageHeight: {
 			pGetValue.setLong(mImageHeight);
+            return true;
+		}; break;
+		case oIM_maxthreads: {
+			pGetValue.setLong(mMaxThreads);
+            return true;
+		}; break;
+		case oIM_encodecount: {
+			// our own encodes and those of our layers
+			qlong	count = mEncodeCount;
+			for	(qulong layer = 0;layer < mLayers.size(); layer++) {
+				count += mLayers[layer]->encodeCount();
+			};
+			pGetValue.setLong(count);
+            return true;
+		}; break;
+		case oIM_pngcompression: {
+			pGetValue.setLong(mCompression);
+            return true;
+		}; break;
+		case oIM_maxdecodepixels: {
+			pGetValue.setLong(mMaxDecodePixels);
             return true;
 		}; break;
 		case oIM_currentlayer: {
@@ -307,7 +544,17 @@ qbool oImage::getProperty(qlong pPropID,EXTfldval &pGetValue,EXTCompInfo* pECI)
 		}; break;
 		case oIM_layercontents: {
 			oImgLayer	*layer = mLayers[mCurrentLayer-1];
-			layer->getContents(pGetValue);
+			layer->getContents(pGetValue, mCompression);
+            return true;
+		}; break;
+		case oIM_layerfilter: {
+			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			pGetValue.setLong(layer->filter());
+            return true;
+		}; break;
+		case oIM_layerdecodescale: {
+			oImgLayer	*layer = mLayers[mCurrentLayer-1];
+			pGetValue.setLong(layer->decodeScale());
             return true;
 		}; break;
 		default:
@@ -326,11 +573,18 @@ ECOparam remLayerParams[] = {
 	7100,			fftInteger,		0,					0,		// layer
 };
 
+ECOparam imageAsParams[] = {
+	//	Resource	Type			Flags				ExFlags
+	7101,			fftInteger,		0,					0,		// format
+	7102,			fftInteger,		EXTD_FLAG_PARAMOPT,	0,		// quality
+};
+
 // This is our array of methods we support
 ECOmethodEvent oImageMethods[] = {
 	//	ID				Resource	Return type		Paramcount		Params					Flags		ExFlags
 	oIM_addlayer,		8100,		fftNone,		0,				NULL,					0,			0,			// $addLayer	
 	oIM_remlayer,		8101,		fftNone,		1,				remLayerParams,			0,			0,			// $remLayer	
+	oIM_imageas,		8102,		fftBinary,		2,				imageAsParams,			0,			0,			// $imageas	
 };
 
 // return array of method meta data
@@ -354,7 +608,7 @@ int	oImage::invokeMethod(qlong pMethodId, EXTCompInfo* pECI) {
 			mLayers.push_back(bitmap);
 			mCurrentLayer = mLayers.size();
 			
-			clearCachedImg();
+			markLayerDirty(bitmap);
 
 			return 1L;							
 		}; break;
@@ -367,6 +621,50 @@ int	oImage::invokeMethod(qlong pMethodId, EXTCompInfo* pECI) {
 			
 			return 1L;							
 		}; break;
+		case oIM_imageas: { // return our image in another format
+			EXTfldval			lvResult;
+			EXTParamInfo*		param1 = ECOfindParamNum( pECI, 1 );
+			qlong				lvFormat = oIMFMT_png;
+			qlong				lvQuality = 75;
+			
+			if (param1 != NULL) {
+				EXTfldval		tmpData((qfldval) param1->mData);
+				lvFormat = tmpData.getLong();
+			};
+			if (ECOgetParamCount(pECI) > 1) {
+				EXTParamInfo*	param2 = ECOfindParamNum( pECI, 2 );
+				EXTfldval		tmpData((qfldval) param2->mData);
+				lvQuality = tmpData.getLong();
+			};
+			
+			if (lvFormat == oIMFMT_png) {
+				// same as $image
+				getEncodedImage(lvResult);
+			} else {
+				updateCachedImg(mImageWidth, mImageHeight);
+				
+				int				len = 0;
+				unsigned char *	data = NULL;
+				if (mCachedImage == NULL) {
+					// nothing to return
+				} else if (lvFormat == oIMFMT_raw) {
+					data = oImgEncoder::encodeRaw(mCachedImage->imagebuffer(), mCachedWidth, mCachedHeight, len);
+				} else if (lvFormat == oIMFMT_jpeg) {
+					data = oImgEncoder::encodeJPEG(mCachedImage->imagebuffer(), mCachedWidth, mCachedHeight, lvQuality, len);
+					mEncodeCount++;
+				};
+				
+				if (data != NULL) {
+					lvResult.setBinary(fftBinary, data, len);
+					free(data);
+				} else {
+					lvResult.setEmpty(fftBinary, 0);
+				};
+			};
+			
+			ECOaddParam(pECI, &lvResult);
+			return 1L;
+		}; break;
 		default: {
 			return oBaseNVComponent::invokeMethod(pMethodId, pECI);
 		}; break;
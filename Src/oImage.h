@@ -13,6 +13,7 @@
 
 #include "omnis.xcomp.framework.h"
 #include "oImgLayer.h"
+#include "oThread.h"
 
 enum oImagePropIDs {
 	oIM_layerCount			= 1,
@@ -27,27 +28,57 @@ enum oImagePropIDs {
 	oIM_image				= 10,
 	oIM_imageWidth			= 11,
 	oIM_imageHeight			= 12,
+	oIM_layerfilter			= 13,
+	oIM_maxthreads			= 14,
+	oIM_encodecount			= 15,
+	oIM_pngcompression		= 16,
+	oIM_maxdecodepixels		= 17,
+	oIM_layerdecodescale	= 18,
 };
 
 enum oImageMethodIDs {
 	oIM_addlayer			= 1,
 	oIM_remlayer			= 2,
+	oIM_imageas				= 3,
 };
 
+class oImage;
+
+typedef struct sImgBand {
+	oImage *					mImage;		// image we're compositing
+	sImgRect					mRect;		// band of rows this thread composites
+} sImgBand;
+
 class oImage : public oBaseNVComponent {
 private:
 	std::vector<oImgLayer *>	mLayers;															// image layers
 	qlong						mCurrentLayer;														// current layer we have selected. Note mCurrentLayer = 1 => mLayers[0] !!
 	qdim						mImageWidth;														// width of our resulting image
 	qdim						mImageHeight;														// height of our resulting image
+	qlong						mMaxThreads;														// maximum number of threads we composite with, 0 = one per core
 	
 	
 	oRGBAImage *				mCachedImage;
 	qlong						mCachedWidth;
 	qlong						mCachedHeight;
+	std::vector<sImgRect>		mDirty;																// areas of our cached image that need to be recomposited
+	unsigned char *				mEncoded;															// our cached image encoded as PNG, NULL if it needs to be encoded again
+	int							mEncodedLen;														// length of mEncoded
+	qlong						mEncodeCount;														// number of times we've encoded our cached image
+	qlong						mCompression;														// PNG compression we encode with, one of our oImgCompression values
+	qlong						mMaxDecodePixels;													// images assigned to $layercontents with more pixels than this are refused, 0 = no limit
+	
+	void						clearEncoded();														// our cached image changed, forget its encoded version
+	void						getEncodedImage(EXTfldval &pValue);								// return our image as PNG, encoding it only if it changed
 	
 	void						clearCachedImg();													// clear our cached image
 	void						updateCachedImg(qdim pWidth, qdim pHeight);						// update our cached image
+	void						markDirty(sImgRect pRect);											// mark an area of our cached image as out of date
+	void						markLayerDirty(oImgLayer * pLayer);								// mark the area covered by this layer as out of date
+	qlong						firstEnabledLayer();												// index of the first layer we draw, this one is copied instead of mixed
+	void						compositeRegion(sImgRect pRect);									// recomposite this area of our cached image
+	void						compositeBand(sImgRect pRect);										// recomposite a band of our cached image, called from our worker threads
+	static void					runCompositeBand(void * pBand);										// entry point for our worker threads, pBand is a sImgBand
 protected:
 public:
 	oImage(void);
@@ -0,0 +1,1153 @@
+/*
+ *  omnis.xcomp.widget
+ *  ===================
+ *
+ *  oImgEncoder.cpp
+ *  Source for our image encoders
+ *
+ *  Bastiaan Olij
+ */
+
+#include "oImgEncoder.h"
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <queue>
+#include <functional>
+#include <math.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// deflate tables, see RFC 1951
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const unsigned short	oImgLengthBase[29]	= { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char	oImgLengthExtra[29]	= { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short	oImgDistBase[30]	= { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char	oImgDistExtra[30]	= { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char	oImgCodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+#define OIMG_WINDOW			32768
+#define OIMG_WINDOWMASK		(OIMG_WINDOW - 1)
+#define OIMG_HASHSIZE		32768
+#define OIMG_MINMATCH		3
+#define OIMG_MAXMATCH		258
+#define OIMG_BLOCKSYMBOLS	32768
+
+static inline int	oImgLengthCode(int pLength) {
+	int	code = 28;
+	while (oImgLengthBase[code] > pLength) {
+		code--;
+	};
+	return code;
+};
+
+static inline int	oImgDistCode(int pDist) {
+	int	code = 29;
+	while (oImgDistBase[code] > pDist) {
+		code--;
+	};
+	return code;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// oImgDeflate
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+oImgDeflate::oImgDeflate(std::vector<unsigned char> & pOut, qlong pLevel) : mOut(pOut) {
+	mLevel		= pLevel;
+	mBitBuffer	= 0;
+	mBitCount	= 0;
+};
+
+// write bits, LSB first
+void	oImgDeflate::putBits(unsigned int pBits, int pCount) {
+	mBitBuffer |= pBits << mBitCount;
+	mBitCount += pCount;
+	while (mBitCount >= 8) {
+		mOut.push_back((unsigned char) (mBitBuffer & 0xFF));
+		mBitBuffer >>= 8;
+		mBitCount -= 8;
+	};
+};
+
+// pad to a byte boundary
+void	oImgDeflate::flushBits() {
+	if (mBitCount > 0) {
+		mOut.push_back((unsigned char) (mBitBuffer & 0xFF));
+	};
+	mBitBuffer	= 0;
+	mBitCount	= 0;
+};
+
+unsigned int	oImgDeflate::adler32(const unsigned char * pData, qlong pLen) {
+	unsigned int	a = 1, b = 0;
+
+	while (pLen > 0) {
+		// 5552 is the largest run we can add up before we need to take the modulo
+		qlong	run = pLen > 5552 ? 5552 : pLen;
+		pLen -= run;
+		while (run > 0) {
+			a += *pData++;
+			b += a;
+			run--;
+		};
+		a %= 65521;
+		b %= 65521;
+	};
+
+	return (b << 16) | a;
+};
+
+// length limited huffman code lengths
+void	oImgDeflate::buildLengths(const unsigned int * pFreqs, int pCount, int pMaxLength, unsigned char * pLengths) {
+	std::vector<unsigned int>	freqs(pFreqs, pFreqs + pCount);
+
+	while (true) {
+		typedef std::pair<unsigned int, int>	node;
+		std::priority_queue<node, std::vector<node>, std::greater<node> >	queue;
+		std::vector<int>	parents;
+
+		memset(pLengths, 0, pCount);
+		for (int i = 0; i < pCount; i++) {
+			if (freqs[i] > 0) {
+				queue.push(node(freqs[i], (int) parents.size()));
+				parents.push_back(-1);
+			};
+		};
+
+		if (parents.size() == 0) {
+			return;
+		};
+
+		// combine our two least frequent nodes until we have our root
+		while (queue.size() > 1) {
+			node	a = queue.top();
+			queue.pop();
+			node	b = queue.top();
+			queue.pop();
+
+			int		parent = (int) parents.size();
+			parents.push_back(-1);
+			parents[a.second] = parent;
+			parents[b.second] = parent;
+			queue.push(node(a.first + b.first, parent));
+		};
+
+		// our leaves are the first nodes we added, their depth is their code length
+		int	leaf		= 0;
+		int	maxlength	= 0;
+		for (int i = 0; i < pCount; i++) {
+			if (freqs[i] > 0) {
+				int	length = 0;
+				for (int n = leaf; parents[n] != -1; n = parents[n]) {
+					length++;
+				};
+				if (length == 0) {
+					// a single symbol still needs one bit
+					length = 1;
+				};
+				pLengths[i] = (unsigned char) length;
+				if (length > maxlength) maxlength = length;
+				leaf++;
+			};
+		};
+
+		if (maxlength <= pMaxLength) {
+			return;
+		};
+
+		// flatten our frequencies and try again
+		for (int i = 0; i < pCount; i++) {
+			if (freqs[i] > 0) {
+				freqs[i] = (freqs[i] >> 1) | 1;
+			};
+		};
+	};
+};
+
+// canonical codes for these lengths, bit reversed so we can write them LSB first
+void	oImgDeflate::buildCodes(const unsigned char * pLengths, int pCount, unsigned short * pCodes) {
+	unsigned short	counts[16];
+	unsigned short	next[16];
+
+	memset(counts, 0, sizeof(counts));
+	for (int i = 0; i < pCount; i++) {
+		counts[pLengths[i]]++;
+	};
+	counts[0] = 0;
+
+	unsigned short	code = 0;
+	for (int bits = 1; bits < 16; bits++) {
+		code = (code + counts[bits - 1]) << 1;
+		next[bits] = code;
+	};
+
+	for (int i = 0; i < pCount; i++) {
+		int	length = pLengths[i];
+		if (length == 0) {
+			pCodes[i] = 0;
+		} else {
+			unsigned short	value = next[length]++;
+			unsigned short	reversed = 0;
+			for (int b = 0; b < length; b++) {
+				reversed = (reversed << 1) | (value & 1);
+				value >>= 1;
+			};
+			pCodes[i] = reversed;
+		};
+	};
+};
+
+void	oImgDeflate::writeStored(const unsigned char * pData, qlong pLen, bool pFinal) {
+	putBits(pFinal ? 1 : 0, 1);
+	putBits(0, 2);
+	flushBits();
+
+	mOut.push_back((unsigned char) (pLen & 0xFF));
+	mOut.push_back((unsigned char) ((pLen >> 8) & 0xFF));
+	mOut.push_back((unsigned char) (~pLen & 0xFF));
+	mOut.push_back((unsigned char) ((~pLen >> 8) & 0xFF));
+	mOut.insert(mOut.end(), pData, pData + pLen);
+};
+
+void	oImgDeflate::writeSymbols(const unsigned char * pLitLenLengths, const unsigned short * pLitLenCodes, const unsigned char * pDistLengths, const unsigned short * pDistCodes) {
+	for (qulong s = 0; s < mSymbols.size(); s++) {
+		const sSymbol &	symbol = mSymbols[s];
+
+		if (symbol.mDist == 0) {
+			putBits(pLitLenCodes[symbol.mLitLen], pLitLenLengths[symbol.mLitLen]);
+		} else {
+			int	lcode = oImgLengthCode(symbol.mLitLen);
+			putBits(pLitLenCodes[257 + lcode], pLitLenLengths[257 + lcode]);
+			if (oImgLengthExtra[lcode] > 0) {
+				putBits(symbol.mLitLen - oImgLengthBase[lcode], oImgLengthExtra[lcode]);
+			};
+
+			int	dcode = oImgDistCode(symbol.mDist);
+			putBits(pDistCodes[dcode], pDistLengths[dcode]);
+			if (oImgDistExtra[dcode] > 0) {
+				putBits(symbol.mDist - oImgDistBase[dcode], oImgDistExtra[dcode]);
+			};
+		};
+	};
+
+	// end of block
+	putBits(pLitLenCodes[256], pLitLenLengths[256]);
+	mSymbols.clear();
+};
+
+// write mSymbols as a fixed or dynamic huffman block, or as stored if that is smaller, pData is the data our symbols cover
+void	oImgDeflate::writeBlock(const unsigned char * pData, qlong pLen, bool pFinal) {
+	unsigned char	litlenLengths[288];
+	unsigned short	litlenCodes[288];
+	unsigned char	distLengths[30];
+	unsigned short	distCodes[30];
+	unsigned char	clLengths[19];
+	unsigned short	clCodes[19];
+	int				hlit = 0, hdist = 0, hclen = 0;
+	qlong			bits = 3;
+
+	// count our symbols first
+	unsigned int	litlenFreqs[286];
+	unsigned int	distFreqs[30];
+	memset(litlenFreqs, 0, sizeof(litlenFreqs));
+	memset(distFreqs, 0, sizeof(distFreqs));
+	for (qulong s = 0; s < mSymbols.size(); s++) {
+		if (mSymbols[s].mDist == 0) {
+			litlenFreqs[mSymbols[s].mLitLen]++;
+		} else {
+			int	lcode = oImgLengthCode(mSymbols[s].mLitLen);
+			int	dcode = oImgDistCode(mSymbols[s].mDist);
+			litlenFreqs[257 + lcode]++;
+			distFreqs[dcode]++;
+			bits += oImgLengthExtra[lcode] + oImgDistExtra[dcode];
+		};
+	};
+	litlenFreqs[256] = 1;
+
+	std::vector<unsigned char>	rle;		// code length symbol followed by its extra bits value
+
+	if (mLevel != oIMC_best) {
+		// fixed huffman codes
+		for (int i = 0; i < 288; i++) {
+			litlenLengths[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8));
+		};
+		memset(distLengths, 5, sizeof(distLengths));
+		buildCodes(litlenLengths, 288, litlenCodes);
+		buildCodes(distLengths, 30, distCodes);
+	} else {
+		// dynamic huffman codes
+		// some decoders choke on codes with a single symbol so we always have at least two
+		if (litlenFreqs[0] == 0) litlenFreqs[0] = 1;
+		if (distFreqs[0] == 0) distFreqs[0] = 1;
+		if (distFreqs[1] == 0) distFreqs[1] = 1;
+
+		buildLengths(litlenFreqs, 286, 15, litlenLengths);
+		buildLengths(distFreqs, 30, 15, distLengths);
+		buildCodes(litlenLengths, 286, litlenCodes);
+		buildCodes(distLengths, 30, distCodes);
+
+		hlit = 286;
+		while ((hlit > 257) && (litlenLengths[hlit - 1] == 0)) hlit--;
+		hdist = 30;
+		while ((hdist > 1) && (distLengths[hdist - 1] == 0)) hdist--;
+
+		// run length encode our code lengths
+		unsigned char	lengths[286 + 30];
+		memcpy(lengths, litlenLengths, hlit);
+		memcpy(lengths + hlit, distLengths, hdist);
+
+		unsigned int	clFreqs[19];
+		memset(clFreqs, 0, sizeof(clFreqs));
+
+		int	total = hlit + hdist;
+		for (int i = 0; i < total; ) {
+			int	run = 1;
+			while ((i + run < total) && (lengths[i + run] == lengths[i])) {
+				run++;
+			};
+
+			if (lengths[i] == 0) {
+				int	left = run;
+				while (left >= 11) {
+					int	n = left > 138 ? 138 : left;
+					rle.push_back(18);
+					rle.push_back((unsigned char) (n - 11));
+					clFreqs[18]++;
+					left -= n;
+				};
+				if (left >= 3) {
+					rle.push_back(17);
+					rle.push_back((unsigned char) (left - 3));
+					clFreqs[17]++;
+					left = 0;
+				};
+				while (left > 0) {
+					rle.push_back(0);
+					rle.push_back(0);
+					clFreqs[0]++;
+					left--;
+				};
+			} else {
+				rle.push_back(lengths[i]);
+				rle.push_back(0);
+				clFreqs[lengths[i]]++;
+
+				int	left = run - 1;
+				while (left >= 3) {
+					int	n = left > 6 ? 6 : left;
+					rle.push_back(16);
+					rle.push_back((unsigned char) (n - 3));
+					clFreqs[16]++;
+					left -= n;
+				};
+				while (left > 0) {
+					rle.push_back(lengths[i]);
+					rle.push_back(0);
+					clFreqs[lengths[i]]++;
+					left--;
+				};
+			};
+
+			i += run;
+		};
+
+		int	used = 0;
+		for (int i = 0; i < 19; i++) {
+			if (clFreqs[i] > 0) used++;
+		};
+		if (used < 2) {
+			// same as above, make sure we have at least two codes
+			if (clFreqs[0] == 0) clFreqs[0] = 1; else clFreqs[1] = 1;
+		};
+		buildLengths(clFreqs, 19, 7, clLengths);
+		buildCodes(clLengths, 19, clCodes);
+
+		hclen = 19;
+		while ((hclen > 4) && (clLengths[oImgCodeLengthOrder[hclen - 1]] == 0)) hclen--;
+
+		bits += 14 + (3 * hclen);
+		for (qulong i = 0; i < rle.size(); i += 2) {
+			bits += clLengths[rle[i]] + (rle[i] == 16 ? 2 : (rle[i] == 17 ? 3 : (rle[i] == 18 ? 7 : 0)));
+		};
+	};
+
+	for (int i = 0; i < 286; i++) {
+		bits += (qlong) litlenFreqs[i] * litlenLengths[i];
+	};
+	for (int i = 0; i < 30; i++) {
+		bits += (qlong) distFreqs[i] * distLengths[i];
+	};
+
+	if (bits > (pLen + (5 * ((pLen / 65535) + 1))) * 8) {
+		// our data doesn't compress, store it as is
+		qlong	offset = 0;
+		do {
+			qlong	len = pLen - offset > 65535 ? 65535 : pLen - offset;
+			writeStored(pData + offset, len, pFinal && (offset + len == pLen));
+			offset += len;
+		} while (offset < pLen);
+
+		mSymbols.clear();
+		return;
+	};
+
+	putBits(pFinal ? 1 : 0, 1);
+	if (mLevel != oIMC_best) {
+		putBits(1, 2);
+	} else {
+		// and write our block header
+		putBits(2, 2);
+		putBits(hlit - 257, 5);
+		putBits(hdist - 1, 5);
+		putBits(hclen - 4, 4);
+		for (int i = 0; i < hclen; i++) {
+			putBits(clLengths[oImgCodeLengthOrder[i]], 3);
+		};
+		for (qulong i = 0; i < rle.size(); i += 2) {
+			unsigned char	symbol = rle[i];
+			putBits(clCodes[symbol], clLengths[symbol]);
+			if (symbol == 16) {
+				putBits(rle[i + 1], 2);
+			} else if (symbol == 17) {
+				putBits(rle[i + 1], 3);
+			} else if (symbol == 18) {
+				putBits(rle[i + 1], 7);
+			};
+		};
+	};
+
+	writeSymbols(litlenLengths, litlenCodes, distLengths, distCodes);
+};
+
+#define OIMG_HASH(p)	((((unsigned int) pData[p] << 10) ^ ((unsigned int) pData[(p) + 1] << 5) ^ pData[(p) + 2]) & (OIMG_HASHSIZE - 1))
+
+// add the string starting at pPos to our hash chains
+void	oImgDeflate::insertHash(const unsigned char * pData, qlong pLen, qlong pPos, std::vector<int> & pHead, std::vector<int> & pPrev) {
+	if (pPos + OIMG_MINMATCH <= pLen) {
+		unsigned int	h = OIMG_HASH(pPos);
+		pPrev[pPos & OIMG_WINDOWMASK] = pHead[h];
+		pHead[h] = (int) pPos;
+	};
+};
+
+// find the longest earlier string matching the one at pPos
+void	oImgDeflate::findMatch(const unsigned char * pData, qlong pLen, qlong pPos, const std::vector<int> & pHead, const std::vector<int> & pPrev, int pMaxChain, int pNiceLength, int & pLength, int & pDist) {
+	pLength	= 0;
+	pDist	= 0;
+	if (pPos + OIMG_MINMATCH > pLen) {
+		return;
+	};
+
+	int		maxlen	= pLen - pPos > OIMG_MAXMATCH ? OIMG_MAXMATCH : (int) (pLen - pPos);
+	int		chain	= pMaxChain;
+	qlong	cand	= pHead[OIMG_HASH(pPos)];
+
+	while ((cand >= 0) && (pPos - cand <= OIMG_WINDOW) && (chain-- > 0)) {
+		if (pData[cand + pLength] == pData[pPos + pLength]) {
+			int	len = 0;
+			while ((len < maxlen) && (pData[cand + len] == pData[pPos + len])) {
+				len++;
+			};
+			if (len > pLength) {
+				pLength	= len;
+				pDist	= (int) (pPos - cand);
+				if (len >= pNiceLength) break;
+			};
+		};
+
+		// older entries in our window may have been overwritten by newer ones
+		int	next = pPrev[cand & OIMG_WINDOWMASK];
+		if (next >= cand) break;
+		cand = next;
+	};
+
+	if (pLength < OIMG_MINMATCH) {
+		pLength	= 0;
+		pDist	= 0;
+	};
+};
+
+#undef OIMG_HASH
+
+// write pData as a complete zlib stream
+void	oImgDeflate::compress(const unsigned char * pData, qlong pLen) {
+	// zlib header, our level is only a hint for the reader
+	mOut.push_back(0x78);
+	mOut.push_back(mLevel == oIMC_best ? 0xDA : 0x01);
+
+	if (mLevel == oIMC_none) {
+		qlong	offset = 0;
+		do {
+			qlong	len = pLen - offset > 65535 ? 65535 : pLen - offset;
+			writeStored(pData + offset, len, offset + len == pLen);
+			offset += len;
+		} while (offset < pLen);
+	} else {
+		// LZ77 with hash chains, fast only looks at a few candidates, best looks further and checks if the next byte gives a longer match
+		int		maxchain	= mLevel == oIMC_best ? 128 : 4;
+		int		nicelength	= mLevel == oIMC_best ? OIMG_MAXMATCH : 32;
+		bool	lazy		= mLevel == oIMC_best;
+
+		std::vector<int>	head(OIMG_HASHSIZE, -1);
+		std::vector<int>	prev(OIMG_WINDOW, -1);
+
+		mSymbols.reserve(OIMG_BLOCKSYMBOLS + 1);
+
+		qlong	pos			= 0;
+		qlong	blockstart	= 0;
+		while (pos < pLen) {
+			int		matchlen	= 0;
+			int		matchdist	= 0;
+			qlong	insertfrom	= pos;
+
+			findMatch(pData, pLen, pos, head, prev, maxchain, nicelength, matchlen, matchdist);
+
+			if (lazy && (matchlen >= OIMG_MINMATCH) && (matchlen < nicelength) && (pos + 1 < pLen)) {
+				// see if we get a longer match by emitting a literal first
+				int	nextlen		= 0;
+				int	nextdist	= 0;
+
+				insertHash(pData, pLen, pos, head, prev);
+				insertfrom++;
+				findMatch(pData, pLen, pos + 1, head, prev, maxchain, nicelength, nextlen, nextdist);
+				if (nextlen > matchlen) {
+					matchlen = 0;
+				};
+			};
+
+			sSymbol	symbol;
+			qlong	advance;
+			if (matchlen >= OIMG_MINMATCH) {
+				symbol.mLitLen	= (unsigned short) matchlen;
+				symbol.mDist	= (unsigned short) matchdist;
+				advance = matchlen;
+			} else {
+				symbol.mLitLen	= pData[pos];
+				symbol.mDist	= 0;
+				advance = 1;
+			};
+			mSymbols.push_back(symbol);
+
+			for (qlong p = insertfrom; p < pos + advance; p++) {
+				insertHash(pData, pLen, p, head, prev);
+			};
+			pos += advance;
+
+			if (mSymbols.size() >= OIMG_BLOCKSYMBOLS) {
+				writeBlock(pData + blockstart, pos - blockstart, pos >= pLen);
+				blockstart = pos;
+			};
+		};
+
+		if ((mSymbols.size() > 0) || (mOut.size() == 2)) {
+			// our last block, or an empty one if we have no data at all
+			writeBlock(pData + blockstart, pos - blockstart, true);
+		};
+	};
+
+	flushBits();
+
+	unsigned int	adler = adler32(pData, pLen);
+	mOut.push_back((unsigned char) (adler >> 24));
+	mOut.push_back((unsigned char) (adler >> 16));
+	mOut.push_back((unsigned char) (adler >> 8));
+	mOut.push_back((unsigned char) adler);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// oImgEncoder
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned int	oImgEncoder::crc32(unsigned int pCrc, const unsigned char * pData, qlong pLen) {
+	static unsigned int	table[256];
+	static bool			initialised = false;
+
+	if (!initialised) {
+		for (unsigned int n = 0; n < 256; n++) {
+			unsigned int	c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			};
+			table[n] = c;
+		};
+		initialised = true;
+	};
+
+	pCrc = ~pCrc;
+	for (qlong i = 0; i < pLen; i++) {
+		pCrc = table[(pCrc ^ pData[i]) & 0xFF] ^ (pCrc >> 8);
+	};
+	return ~pCrc;
+};
+
+void	oImgEncoder::putChunk(std::vector<unsigned char> & pOut, const char * pType, const unsigned char * pData, qlong pLen) {
+	qulong	start = pOut.size();
+
+	pOut.push_back((unsigned char) (pLen >> 24));
+	pOut.push_back((unsigned char) (pLen >> 16));
+	pOut.push_back((unsigned char) (pLen >> 8));
+	pOut.push_back((unsigned char) pLen);
+	pOut.insert(pOut.end(), pType, pType + 4);
+	if (pLen > 0) {
+		pOut.insert(pOut.end(), pData, pData + pLen);
+	};
+
+	// crc covers our type and data
+	unsigned int	crc = crc32(0, &pOut[start + 4], pLen + 4);
+	pOut.push_back((unsigned char) (crc >> 24));
+	pOut.push_back((unsigned char) (crc >> 16));
+	pOut.push_back((unsigned char) (crc >> 8));
+	pOut.push_back((unsigned char) crc);
+};
+
+void	oImgEncoder::filterRow(unsigned char pFilter, const unsigned char * pRow, const unsigned char * pPrior, qlong pLen, int pBpp, unsigned char * pOut) {
+	for (qlong i = 0; i < pLen; i++) {
+		int	a = i >= pBpp ? pRow[i - pBpp] : 0;
+		int	b = pPrior != NULL ? pPrior[i] : 0;
+		int	c = (i >= pBpp) && (pPrior != NULL) ? pPrior[i - pBpp] : 0;
+
+		switch (pFilter) {
+			case 1: {
+				pOut[i] = (unsigned char) (pRow[i] - a);
+			}; break;
+			case 2: {
+				pOut[i] = (unsigned char) (pRow[i] - b);
+			}; break;
+			case 3: {
+				pOut[i] = (unsigned char) (pRow[i] - ((a + b) >> 1));
+			}; break;
+			case 4: {
+				int	p	= a + b - c;
+				int	pa	= abs(p - a);
+				int	pb	= abs(p - b);
+				int	pc	= abs(p - c);
+				pOut[i] = (unsigned char) (pRow[i] - ((pa <= pb) && (pa <= pc) ? a : (pb <= pc ? b : c)));
+			}; break;
+			default: {
+				pOut[i] = pRow[i];
+			}; break;
+		};
+	};
+};
+
+// encode our pixels as PNG, returns a buffer allocated with malloc or NULL on failure
+unsigned char *	oImgEncoder::encodePNG(const sPixel * pPixels, qlong pWidth, qlong pHeight, qlong pCompression, int & pLen) {
+	pLen = 0;
+	if ((pPixels == NULL) || (pWidth <= 0) || (pHeight <= 0)) {
+		return NULL;
+	};
+
+	// no need to write our alpha channel if we're fully opaque
+	bool	opaque = true;
+	for (qlong i = 0; opaque && (i < pWidth * pHeight); i++) {
+		opaque = pPixels[i].mA == 255;
+	};
+
+	int		bpp		= opaque ? 3 : 4;
+	qlong	rowlen	= pWidth * bpp;
+
+	// our filtered scanlines, each starts with its filter type
+	std::vector<unsigned char>	filtered((rowlen + 1) * pHeight);
+	std::vector<unsigned char>	rows(rowlen * 2);
+	std::vector<unsigned char>	candidate(rowlen);
+
+	// none doesn't filter, fast picks between sub and up, best tries all five filters starting with none
+	unsigned char	firstfilter	= (pCompression == oIMC_none) || (pCompression == oIMC_best) ? 0 : 1;
+	unsigned char	lastfilter	= pCompression == oIMC_none ? 0 : (pCompression == oIMC_best ? 4 : 2);
+
+	for (qlong y = 0; y < pHeight; y++) {
+		unsigned char *			row		= &rows[(y & 1) * rowlen];
+		const unsigned char *	prior	= y > 0 ? &rows[((y - 1) & 1) * rowlen] : NULL;
+		const sPixel *			pixels	= pPixels + (y * pWidth);
+		unsigned char *			out		= &filtered[y * (rowlen + 1)];
+
+		for (qlong x = 0; x < pWidth; x++) {
+			unsigned char *	p = row + (x * bpp);
+			p[0] = pixels[x].mR;
+			p[1] = pixels[x].mG;
+			p[2] = pixels[x].mB;
+			if (!opaque) {
+				p[3] = pixels[x].mA;
+			};
+		};
+
+		if (firstfilter == lastfilter) {
+			out[0] = firstfilter;
+			filterRow(firstfilter, row, prior, rowlen, bpp, out + 1);
+		} else {
+			// pick the filter with the smallest sum of absolute (signed) differences, this usually compresses best
+			unsigned long	bestsum = 0;
+			for (unsigned char filter = firstfilter; filter <= lastfilter; filter++) {
+				filterRow(filter, row, prior, rowlen, bpp, &candidate[0]);
+
+				unsigned long	sum = 0;
+				for (qlong i = 0; i < rowlen; i++) {
+					sum += candidate[i] < 128 ? candidate[i] : 256 - candidate[i];
+				};
+				if ((filter == firstfilter) || (sum < bestsum)) {
+					bestsum = sum;
+					out[0] = filter;
+					memcpy(out + 1, &candidate[0], rowlen);
+				};
+			};
+		};
+	};
+
+	std::vector<unsigned char>	png;
+	static const unsigned char	signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	png.insert(png.end(), signature, signature + 8);
+
+	unsigned char	header[13];
+	header[0]	= (unsigned char) (pWidth >> 24);
+	header[1]	= (unsigned char) (pWidth >> 16);
+	header[2]	= (unsigned char) (pWidth >> 8);
+	header[3]	= (unsigned char) pWidth;
+	header[4]	= (unsigned char) (pHeight >> 24);
+	header[5]	= (unsigned char) (pHeight >> 16);
+	header[6]	= (unsigned char) (pHeight >> 8);
+	header[7]	= (unsigned char) pHeight;
+	header[8]	= 8;					// bit depth
+	header[9]	= opaque ? 2 : 6;		// RGB or RGBA
+	header[10]	= 0;					// deflate
+	header[11]	= 0;					// adaptive filtering
+	header[12]	= 0;					// no interlacing
+	putChunk(png, "IHDR", header, 13);
+
+	std::vector<unsigned char>	compressed;
+	compressed.reserve(pCompression == oIMC_none ? filtered.size() + (filtered.size() / 65535 + 1) * 5 + 6 : filtered.size() / 2);
+	oImgDeflate	deflate(compressed, pCompression);
+	deflate.compress(&filtered[0], (qlong) filtered.size());
+	putChunk(png, "IDAT", &compressed[0], (qlong) compressed.size());
+
+	putChunk(png, "IEND", NULL, 0);
+
+	// and return it the same way asPNG does
+	unsigned char *	result = (unsigned char *) malloc(png.size());
+	if (result != NULL) {
+		memcpy(result, &png[0], png.size());
+		pLen = (int) png.size();
+	};
+	return result;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// jpeg tables, see ITU T.81 annex K
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const unsigned char	oImgZigZag[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const unsigned char	oImgLumaQuant[64] = {
+	16, 11, 10, 16,  24,  40,  51,  61,
+	12, 12, 14, 19,  26,  58,  60,  55,
+	14, 13, 16, 24,  40,  57,  69,  56,
+	14, 17, 22, 29,  51,  87,  80,  62,
+	18, 22, 37, 56,  68, 109, 103,  77,
+	24, 35, 55, 64,  81, 104, 113,  92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static const unsigned char	oImgChromaQuant[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99
+};
+
+static const unsigned char	oImgDCLumaBits[16]		= { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char	oImgDCChromaBits[16]	= { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const unsigned char	oImgDCValues[12]		= { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const unsigned char	oImgACLumaBits[16]		= { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char	oImgACLumaValues[162]	= {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+static const unsigned char	oImgACChromaBits[16]	= { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const unsigned char	oImgACChromaValues[162]	= {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+static const unsigned char *	oImgHuffBits[4]		= { oImgDCLumaBits, oImgACLumaBits, oImgDCChromaBits, oImgACChromaBits };
+static const unsigned char *	oImgHuffValues[4]	= { oImgDCValues, oImgACLumaValues, oImgDCValues, oImgACChromaValues };
+static const unsigned char		oImgHuffClass[4]	= { 0x00, 0x10, 0x01, 0x11 };
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// oImgJPEGWriter
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+oImgJPEGWriter::oImgJPEGWriter(std::vector<unsigned char> & pOut) : mOut(pOut) {
+	mBitBuffer	= 0;
+	mBitCount	= 0;
+
+	// build our huffman codes from our tables
+	memset(mCodes, 0, sizeof(mCodes));
+	memset(mSizes, 0, sizeof(mSizes));
+	for (int table = 0; table < 4; table++) {
+		unsigned short	code	= 0;
+		int				value	= 0;
+		for (int length = 1; length <= 16; length++) {
+			for (int i = 0; i < oImgHuffBits[table][length - 1]; i++) {
+				unsigned char	symbol = oImgHuffValues[table][value++];
+				mCodes[table][symbol] = code++;
+				mSizes[table][symbol] = (unsigned char) length;
+			};
+			code <<= 1;
+		};
+	};
+};
+
+// write bits, MSB first, stuffing 0xFF bytes
+void	oImgJPEGWriter::putBits(unsigned int pBits, int pCount) {
+	mBitBuffer = (mBitBuffer << pCount) | (pBits & ((1u << pCount) - 1));
+	mBitCount += pCount;
+	while (mBitCount >= 8) {
+		unsigned char	byte = (unsigned char) ((mBitBuffer >> (mBitCount - 8)) & 0xFF);
+		mOut.push_back(byte);
+		if (byte == 0xFF) {
+			mOut.push_back(0);
+		};
+		mBitCount -= 8;
+	};
+};
+
+// write a marker segment
+void	oImgJPEGWriter::putMarker(unsigned char pMarker, const unsigned char * pData, int pLen) {
+	mOut.push_back(0xFF);
+	mOut.push_back(pMarker);
+	mOut.push_back((unsigned char) ((pLen + 2) >> 8));
+	mOut.push_back((unsigned char) (pLen + 2));
+	mOut.insert(mOut.end(), pData, pData + pLen);
+};
+
+// DCT, quantise and write a block of 8x8 samples
+void	oImgJPEGWriter::encodeBlock(const float * pBlock, int pQuant, int pTable, int & pDC) {
+	static float	cosines[8][8];
+	static bool		initialised = false;
+
+	if (!initialised) {
+		for (int u = 0; u < 8; u++) {
+			for (int x = 0; x < 8; x++) {
+				cosines[u][x] = (float) ((u == 0 ? sqrt(0.125) : 0.5) * cos(((2 * x + 1) * u * 3.14159265358979323846) / 16.0));
+			};
+		};
+		initialised = true;
+	};
+
+	// separable DCT, rows first then columns
+	float	rows[64];
+	for (int y = 0; y < 8; y++) {
+		for (int u = 0; u < 8; u++) {
+			float	sum = 0.0f;
+			for (int x = 0; x < 8; x++) {
+				sum += cosines[u][x] * pBlock[(y * 8) + x];
+			};
+			rows[(y * 8) + u] = sum;
+		};
+	};
+
+	int	coefs[64];
+	for (int u = 0; u < 8; u++) {
+		for (int v = 0; v < 8; v++) {
+			float	sum = 0.0f;
+			for (int y = 0; y < 8; y++) {
+				sum += cosines[v][y] * rows[(y * 8) + u];
+			};
+			float	q = sum / mQuant[pQuant][(v * 8) + u];
+			coefs[(v * 8) + u] = (int) (q < 0.0f ? q - 0.5f : q + 0.5f);
+		};
+	};
+
+	// DC is coded as the difference with our previous block
+	int	dc		= coefs[0];
+	int	diff	= dc - pDC;
+	pDC = dc;
+
+	int	magnitude	= diff < 0 ? -diff : diff;
+	int	size		= 0;
+	while (magnitude > 0) {
+		size++;
+		magnitude >>= 1;
+	};
+	putBits(mCodes[pTable][size], mSizes[pTable][size]);
+	if (size > 0) {
+		putBits(diff < 0 ? diff + (1 << size) - 1 : diff, size);
+	};
+
+	// AC is coded as runs of zeros followed by a value
+	int	ac		= pTable + 1;
+	int	zeros	= 0;
+	for (int k = 1; k < 64; k++) {
+		int	value = coefs[oImgZigZag[k]];
+		if (value == 0) {
+			zeros++;
+		} else {
+			while (zeros >= 16) {
+				putBits(mCodes[ac][0xF0], mSizes[ac][0xF0]);
+				zeros -= 16;
+			};
+
+			magnitude	= value < 0 ? -value : value;
+			size		= 0;
+			while (magnitude > 0) {
+				size++;
+				magnitude >>= 1;
+			};
+			if (size > 10) {
+				// can't happen with quantisation tables of at least 1 but lets be safe
+				size	= 10;
+				value	= value < 0 ? -1023 : 1023;
+			};
+
+			unsigned char	symbol = (unsigned char) ((zeros << 4) | size);
+			putBits(mCodes[ac][symbol], mSizes[ac][symbol]);
+			putBits(value < 0 ? value + (1 << size) - 1 : value, size);
+			zeros = 0;
+		};
+	};
+	if (zeros > 0) {
+		// end of block
+		putBits(mCodes[ac][0x00], mSizes[ac][0x00]);
+	};
+};
+
+void	oImgJPEGWriter::encode(const sPixel * pPixels, qlong pWidth, qlong pHeight, int pQuality) {
+	if (pQuality < 1) pQuality = 1;
+	if (pQuality > 100) pQuality = 100;
+
+	// scale our quantisation tables the same way the IJG library does
+	int	scale = pQuality < 50 ? 5000 / pQuality : 200 - (pQuality * 2);
+	for (int i = 0; i < 64; i++) {
+		int	luma	= ((oImgLumaQuant[i] * scale) + 50) / 100;
+		int	chroma	= ((oImgChromaQuant[i] * scale) + 50) / 100;
+		mQuant[0][i] = luma < 1 ? 1 : (luma > 255 ? 255 : luma);
+		mQuant[1][i] = chroma < 1 ? 1 : (chroma > 255 ? 255 : chroma);
+	};
+
+	int	sampling = pQuality < 90 ? 2 : 1;		// luma samples per chroma sample in each direction
+
+	// SOI and JFIF header
+	mOut.push_back(0xFF);
+	mOut.push_back(0xD8);
+	static const unsigned char	jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	putMarker(0xE0, jfif, 14);
+
+	// quantisation tables, in zigzag order
+	unsigned char	dqt[130];
+	for (int t = 0; t < 2; t++) {
+		dqt[t * 65] = (unsigned char) t;
+		for (int k = 0; k < 64; k++) {
+			dqt[(t * 65) + 1 + k] = (unsigned char) mQuant[t][oImgZigZag[k]];
+		};
+	};
+	putMarker(0xDB, dqt, 130);
+
+	// frame header
+	unsigned char	sof[15] = {
+		8,
+		(unsigned char) (pHeight >> 8), (unsigned char) pHeight,
+		(unsigned char) (pWidth >> 8), (unsigned char) pWidth,
+		3,
+		1, (unsigned char) ((sampling << 4) | sampling), 0,
+		2, 0x11, 1,
+		3, 0x11, 1
+	};
+	putMarker(0xC0, sof, 15);
+
+	// huffman tables
+	std::vector<unsigned char>	dht;
+	for (int table = 0; table < 4; table++) {
+		int	count = 0;
+		dht.push_back(oImgHuffClass[table]);
+		for (int i = 0; i < 16; i++) {
+			dht.push_back(oImgHuffBits[table][i]);
+			count += oImgHuffBits[table][i];
+		};
+		dht.insert(dht.end(), oImgHuffValues[table], oImgHuffValues[table] + count);
+	};
+	putMarker(0xC4, &dht[0], (int) dht.size());
+
+	// scan header
+	static const unsigned char	sos[10] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+	putMarker(0xDA, sos, 10);
+
+	// we convert one row of MCUs at a time into YCbCr, repeating our edge pixels to fill partial blocks
+	qlong				mcusize		= 8 * sampling;
+	qlong				mcuwidth	= (pWidth + mcusize - 1) / mcusize;
+	qlong				mcuheight	= (pHeight + mcusize - 1) / mcusize;
+	qlong				planewidth	= mcuwidth * mcusize;
+	std::vector<float>	planes[3];
+	for (int c = 0; c < 3; c++) {
+		planes[c].resize(planewidth * mcusize);
+	};
+
+	int		dc[3] = { 0, 0, 0 };
+	float	block[64];
+
+	for (qlong my = 0; my < mcuheight; my++) {
+		for (qlong y = 0; y < mcusize; y++) {
+			qlong	sy = (my * mcusize) + y;
+			if (sy >= pHeight) sy = pHeight - 1;
+			const sPixel *	row = pPixels + (sy * pWidth);
+
+			for (qlong x = 0; x < planewidth; x++) {
+				const sPixel &	pixel = row[x < pWidth ? x : pWidth - 1];
+
+				// JPEG has no alpha, flatten onto white
+				float	a = pixel.mA / 255.0f;
+				float	r = (pixel.mR * a) + (255.0f * (1.0f - a));
+				float	g = (pixel.mG * a) + (255.0f * (1.0f - a));
+				float	b = (pixel.mB * a) + (255.0f * (1.0f - a));
+
+				qlong	offset = (y * planewidth) + x;
+				planes[0][offset] = (0.299f * r) + (0.587f * g) + (0.114f * b) - 128.0f;
+				planes[1][offset] = (-0.168736f * r) - (0.331264f * g) + (0.5f * b);
+				planes[2][offset] = (0.5f * r) - (0.418688f * g) - (0.081312f * b);
+			};
+		};
+
+		for (qlong mx = 0; mx < mcuwidth; mx++) {
+			qlong	left = mx * mcusize;
+
+			// luma blocks
+			for (int by = 0; by < sampling; by++) {
+				for (int bx = 0; bx < sampling; bx++) {
+					for (int y = 0; y < 8; y++) {
+						for (int x = 0; x < 8; x++) {
+							block[(y * 8) + x] = planes[0][(((by * 8) + y) * planewidth) + left + (bx * 8) + x];
+						};
+					};
+					encodeBlock(block, 0, 0, dc[0]);
+				};
+			};
+
+			// chroma blocks, averaged when subsampled
+			for (int c = 1; c < 3; c++) {
+				for (int y = 0; y < 8; y++) {
+					for (int x = 0; x < 8; x++) {
+						float	sum = 0.0f;
+						for (int sy = 0; sy < sampling; sy++) {
+							for (int sx = 0; sx < sampling; sx++) {
+								sum += planes[c][(((y * sampling) + sy) * planewidth) + left + (x * sampling) + sx];
+							};
+						};
+						block[(y * 8) + x] = sum / (sampling * sampling);
+					};
+				};
+				encodeBlock(block, 1, 2, dc[c]);
+			};
+		};
+	};
+
+	// pad our last byte with ones and finish
+	if (mBitCount > 0) {
+		putBits(0x7F, 8 - mBitCount);
+	};
+	mOut.push_back(0xFF);
+	mOut.push_back(0xD9);
+};
+
+// encode our pixels as a baseline JPEG, pQuality goes from 1 to 100, alpha is flattened onto white
+unsigned char *	oImgEncoder::encodeJPEG(const sPixel * pPixels, qlong pWidth, qlong pHeight, int pQuality, int & pLen) {
+	pLen = 0;
+	if ((pPixels == NULL) || (pWidth <= 0) || (pHeight <= 0) || (pWidth > 65535) || (pHeight > 65535)) {
+		// baseline JPEG can't go larger than this
+		return NULL;
+	};
+
+	std::vector<unsigned char>	jpeg;
+	jpeg.reserve((pWidth * pHeight) / 4);
+	oImgJPEGWriter	writer(jpeg);
+	writer.encode(pPixels, pWidth, pHeight, pQuality);
+
+	unsigned char *	result = (unsigned char *) malloc(jpeg.size());
+	if (result != NULL) {
+		memcpy(result, &jpeg[0], jpeg.size());
+		pLen = (int) jpeg.size();
+	};
+	return result;
+};
+
+// our pixels with a small header, no encoding at all
+unsigned char *	oImgEncoder::encodeRaw(const sPixel * pPixels, qlong pWidth, qlong pHeight, int & pLen) {
+	pLen = 0;
+	if ((pPixels == NULL) || (pWidth <= 0) || (pHeight <= 0)) {
+		return NULL;
+	};
+
+	// our size is returned as an int, so make sure we don't overflow it
+	unsigned long long	size = (unsigned long long) pWidth * (unsigned long long) pHeight * 4;
+	if (size > (unsigned long long) (INT_MAX - OIMG_RAWHEADER)) {
+		return NULL;
+	};
+
+	size_t			len		= OIMG_RAWHEADER + (size_t) size;
+	unsigned char *	result	= (unsigned char *) malloc(len);
+	if (result != NULL) {
+		result[0]	= 'R';
+		result[1]	= 'G';
+		result[2]	= 'B';
+		result[3]	= 'A';
+		result[4]	= (unsigned char) (pWidth >> 24);
+		result[5]	= (unsigned char) (pWidth >> 16);
+		result[6]	= (unsigned char) (pWidth >> 8);
+		result[7]	= (unsigned char) pWidth;
+		result[8]	= (unsigned char) (pHeight >> 24);
+		result[9]	= (unsigned char) (pHeight >> 16);
+		result[10]	= (unsigned char) (pHeight >> 8);
+		result[11]	= (unsigned char) pHeight;
+
+		// sPixel is laid out as R, G, B, A so we can copy as is
+		memcpy(result + OIMG_RAWHEADER, pPixels, (size_t) size);
+		pLen = (int) len;
+	};
+	return result;
+};
+
+// check if this is our raw format and if so return its size
+bool	oImgEncoder::rawSize(const unsigned char * pData, qlong pLen, qlong & pWidth, qlong & pHeight) {
+	if ((pData == NULL) || (pLen < OIMG_RAWHEADER) || (memcmp(pData, "RGBA", 4) != 0)) {
+		return false;
+	};
+
+	pWidth	= ((qlong) pData[4] << 24) | ((qlong) pData[5] << 16) | ((qlong) pData[6] << 8) | pData[7];
+	pHeight	= ((qlong) pData[8] << 24) | ((qlong) pData[9] << 16) | ((qlong) pData[10] << 8) | pData[11];
+
+	if ((pWidth <= 0) || (pHeight <= 0)) {
+		return false;
+	};
+
+	// work out our size in 64bit, a crafted header would overflow qlong
+	unsigned long long	size = (unsigned long long) pWidth * (unsigned long long) pHeight * 4;
+	return (size <= (unsigned long long) (pLen - OIMG_RAWHEADER)) && (size <= INT_MAX);
+};
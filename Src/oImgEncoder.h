@@ -0,0 +1,113 @@
+/*
+ *  omnis.xcomp.widget
+ *  ===================
+ *
+ *  oImgEncoder.h
+ *  Header for our image encoders
+ *
+ *  Our own PNG encoder so we can choose between encoding speed and output size:
+ *  - none writes stored deflate blocks without filtering, this is basically a memcpy
+ *  - fast uses a short LZ77 search with fixed huffman codes and picks between the sub and up row filters
+ *  - best uses a longer lazy LZ77 search with dynamic huffman codes and tries all five row filters
+ *  Images that are fully opaque are written as RGB instead of RGBA.
+ *
+ *  Our JPEG encoder writes baseline JPEGs with the standard huffman tables, chroma is subsampled 2x2 below quality 90.
+ *  Our raw format is a 12 byte header (RGBA, width and height as big endian 32 bit integers) followed by our pixels.
+ *
+ *  Bastiaan Olij
+ */
+
+#ifndef oimgencoderh
+#define oimgencoderh
+
+#include "omnis.xcomp.framework.h"
+#include <vector>
+
+enum oImgFormat {
+	oIMFMT_png				= 0,
+	oIMFMT_raw				= 1,
+	oIMFMT_jpeg			= 2,
+};
+
+#define OIMG_RAWHEADER		12
+
+enum oImgCompression {
+	oIMC_none				= 0,
+	oIMC_fast				= 1,
+	oIMC_best				= 2,
+};
+
+// zlib stream compressor
+class oImgDeflate {
+private:
+	struct sSymbol {
+		unsigned short			mLitLen;											// literal (0-255) or match length (3-258)
+		unsigned short			mDist;												// 0 for a literal, otherwise match distance
+	};
+
+	std::vector<unsigned char> &	mOut;											// buffer we write into
+	qlong						mLevel;												// one of our oImgCompression values
+	unsigned int				mBitBuffer;											// bits not yet written
+	int							mBitCount;											// number of bits in mBitBuffer
+	std::vector<sSymbol>		mSymbols;											// symbols for the block we're building
+
+	void						putBits(unsigned int pBits, int pCount);			// write bits, LSB first
+	void						flushBits();										// pad to a byte boundary
+
+	void						writeStored(const unsigned char * pData, qlong pLen, bool pFinal);
+	void						writeBlock(const unsigned char * pData, qlong pLen, bool pFinal);	// write mSymbols as a fixed or dynamic huffman block, or as stored if that is smaller
+	static	void				insertHash(const unsigned char * pData, qlong pLen, qlong pPos, std::vector<int> & pHead, std::vector<int> & pPrev);	// add the string starting at pPos to our hash chains
+	static	void				findMatch(const unsigned char * pData, qlong pLen, qlong pPos, const std::vector<int> & pHead, const std::vector<int> & pPrev, int pMaxChain, int pNiceLength, int & pLength, int & pDist);	// find the longest earlier string matching the one at pPos
+	void						writeSymbols(const unsigned char * pLitLenLengths, const unsigned short * pLitLenCodes, const unsigned char * pDistLengths, const unsigned short * pDistCodes);
+
+	static	void				buildLengths(const unsigned int * pFreqs, int pCount, int pMaxLength, unsigned char * pLengths);	// length limited huffman code lengths
+	static	void				buildCodes(const unsigned char * pLengths, int pCount, unsigned short * pCodes);					// canonical codes for these lengths, bit reversed so we can write them LSB first
+
+public:
+	oImgDeflate(std::vector<unsigned char> & pOut, qlong pLevel);
+
+	void						compress(const unsigned char * pData, qlong pLen);	// write pData as a complete zlib stream
+
+	static	unsigned int		adler32(const unsigned char * pData, qlong pLen);
+};
+
+// baseline JPEG bit writer
+class oImgJPEGWriter {
+private:
+	std::vector<unsigned char> &	mOut;											// buffer we write into
+	unsigned int				mBitBuffer;											// bits not yet written, MSB first
+	int							mBitCount;											// number of bits in mBitBuffer
+	unsigned short				mCodes[4][256];										// huffman codes for our luma DC, luma AC, chroma DC and chroma AC tables
+	unsigned char				mSizes[4][256];										// and their lengths
+	int							mQuant[2][64];										// luma and chroma quantisation tables in natural order
+	
+	void						putBits(unsigned int pBits, int pCount);			// write bits, MSB first, stuffing 0xFF bytes
+	void						putMarker(unsigned char pMarker, const unsigned char * pData, int pLen);	// write a marker segment
+	void						encodeBlock(const float * pBlock, int pQuant, int pTable, int & pDC);	// DCT, quantise and write a block of 8x8 samples
+
+public:
+	oImgJPEGWriter(std::vector<unsigned char> & pOut);
+	
+	void						encode(const sPixel * pPixels, qlong pWidth, qlong pHeight, int pQuality);
+};
+
+class oImgEncoder {
+private:
+	static	void				filterRow(unsigned char pFilter, const unsigned char * pRow, const unsigned char * pPrior, qlong pLen, int pBpp, unsigned char * pOut);
+	static	void				putChunk(std::vector<unsigned char> & pOut, const char * pType, const unsigned char * pData, qlong pLen);
+
+public:
+	static	unsigned int		crc32(unsigned int pCrc, const unsigned char * pData, qlong pLen);
+
+	// encode our pixels as PNG, returns a buffer allocated with malloc or NULL on failure
+	static	unsigned char *		encodePNG(const sPixel * pPixels, qlong pWidth, qlong pHeight, qlong pCompression, int & pLen);
+	
+	// encode our pixels as a baseline JPEG, pQuality goes from 1 to 100, alpha is flattened onto white
+	static	unsigned char *		encodeJPEG(const sPixel * pPixels, qlong pWidth, qlong pHeight, int pQuality, int & pLen);
+	
+	// our pixels with a small header, no encoding at all
+	static	unsigned char *		encodeRaw(const sPixel * pPixels, qlong pWidth, qlong pHeight, int & pLen);
+	static	bool				rawSize(const unsigned char * pData, qlong pLen, qlong & pWidth, qlong & pHeight);	// check if this is our raw format and if so return its size
+};
+
+#endif
@@ -18,6 +18,232 @@
  */
 
 #include "oImgLayer.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define OIMG_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define OIMG_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+	#include <arm_neon.h>
+	#define OIMG_NEON
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// oImgResampler
+//
+// We resample in two passes, first horizontally into a 16 bit premultiplied buffer, then vertically.
+// When shrinking the filter is widened by the scale factor so every source pixel contributes.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define OIMG_WEIGHTBITS		14
+#define OIMG_WEIGHTONE		(1 << OIMG_WEIGHTBITS)
+#define OIMG_MIDBITS		7			// extra precision kept in our intermediate buffer
+
+// radius of our filter at scale 1
+double	oImgResampler::filterSupport(qlong pFilter) {
+	switch (pFilter) {
+		case oIMF_box:
+			return 0.5;
+			break;
+		case oIMF_bicubic:
+			return 2.0;
+			break;
+		case oIMF_lanczos:
+			return 3.0;
+			break;
+		default:
+			return 1.0;
+			break;
+	};
+};
+
+// weight of our filter at distance pX
+double	oImgResampler::filterWeight(qlong pFilter, double pX) {
+	pX = fabs(pX);
+
+	switch (pFilter) {
+		case oIMF_box: {
+			return pX <= 0.5 ? 1.0 : 0.0;
+		}; break;
+		case oIMF_bicubic: {
+			// Catmull-Rom
+			if (pX < 1.0) {
+				return ((1.5 * pX - 2.5) * pX * pX) + 1.0;
+			} else if (pX < 2.0) {
+				return (((-0.5 * pX + 2.5) * pX - 4.0) * pX) + 2.0;
+			} else {
+				return 0.0;
+			};
+		}; break;
+		case oIMF_lanczos: {
+			// Lanczos 3
+			if (pX < 1.0e-6) {
+				return 1.0;
+			} else if (pX < 3.0) {
+				double	piX = 3.14159265358979323846 * pX;
+				return (3.0 * sin(piX) * sin(piX / 3.0)) / (piX * piX);
+			} else {
+				return 0.0;
+			};
+		}; break;
+		default: {
+			// bilinear
+			return pX < 1.0 ? 1.0 - pX : 0.0;
+		}; break;
+	};
+};
+
+void	oImgResampler::buildWeights(sWeights & pWeights, qlong pSource, qlong pDest, qlong pFilter) {
+	double	scale	= (double) pSource / (double) pDest;
+	double	widen	= scale > 1.0 ? scale : 1.0;
+	double	support	= filterSupport(pFilter) * widen;
+
+	pWeights.mTaps = (qlong) ceil(support * 2.0) + 1;
+	pWeights.mFirst.resize(pDest);
+	pWeights.mCount.resize(pDest);
+	pWeights.mWeights.assign(pDest * pWeights.mTaps, 0);
+
+	std::vector<double>	weights(pWeights.mTaps);
+
+	for (qlong i = 0; i < pDest; i++) {
+		double	center	= ((i + 0.5) * scale) - 0.5;
+		qlong	first	= (qlong) floor(center - support + 0.5);
+		qlong	last	= (qlong) floor(center + support + 0.5);
+		if (first < 0) first = 0;
+		if (last > pSource - 1) last = pSource - 1;
+		if (last - first + 1 > pWeights.mTaps) last = first + pWeights.mTaps - 1;
+
+		// calculate our weights and normalise them
+		double	total = 0.0;
+		qlong	count = last - first + 1;
+		for (qlong k = 0; k < count; k++) {
+			weights[k] = filterWeight(pFilter, (first + k - center) / widen);
+			total += weights[k];
+		};
+
+		int *	fixed = &pWeights.mWeights[i * pWeights.mTaps];
+		if (total == 0.0) {
+			// can happen with our box filter, just take the nearest pixel
+			qlong nearest = (qlong) floor(center + 0.5);
+			if (nearest < first) nearest = first;
+			if (nearest > last) nearest = last;
+			fixed[nearest - first] = OIMG_WEIGHTONE;
+		} else {
+			// convert to fixed point and make sure we add up to exactly 1
+			int		sum		= 0;
+			qlong	largest	= 0;
+			for (qlong k = 0; k < count; k++) {
+				fixed[k] = (int) floor((weights[k] / total * OIMG_WEIGHTONE) + 0.5);
+				sum += fixed[k];
+				if (fixed[k] > fixed[largest]) largest = k;
+			};
+			fixed[largest] += OIMG_WEIGHTONE - sum;
+		};
+
+		// strip zero weights from the end so we don't loop over them
+		while ((count > 1) && (fixed[count - 1] == 0)) {
+			count--;
+		};
+
+		pWeights.mFirst[i] = first;
+		pWeights.mCount[i] = count;
+	};
+};
+
+void	oImgResampler::resample(const sPixel * pSource, qlong pSourceWidth, qlong pSourceHeight, sPixel * pDest, qlong pDestWidth, qlong pDestHeight, qlong pFilter) {
+	if ((pSourceWidth <= 0) || (pSourceHeight <= 0) || (pDestWidth <= 0) || (pDestHeight <= 0)) {
+		return;
+	};
+
+	sWeights	horz, vert;
+	buildWeights(horz, pSourceWidth, pDestWidth, pFilter);
+	buildWeights(vert, pSourceHeight, pDestHeight, pFilter);
+
+	// horizontal pass, premultiply our source row and filter it into our intermediate buffer
+	std::vector<unsigned short>	mid(pDestWidth * pSourceHeight * 4);
+	std::vector<int>			premul(pSourceWidth * 4);
+
+	for (qlong y = 0; y < pSourceHeight; y++) {
+		const sPixel *	src = pSource + (y * pSourceWidth);
+		for (qlong x = 0; x < pSourceWidth; x++) {
+			int	a = src[x].mA;
+			premul[(x * 4) + 0] = (src[x].mR * a + 127) / 255;
+			premul[(x * 4) + 1] = (src[x].mG * a + 127) / 255;
+			premul[(x * 4) + 2] = (src[x].mB * a + 127) / 255;
+			premul[(x * 4) + 3] = a;
+		};
+
+		unsigned short *	out = &mid[y * pDestWidth * 4];
+		for (qlong x = 0; x < pDestWidth; x++) {
+			const int *	weights	= &horz.mWeights[x * horz.mTaps];
+			const int *	in		= &premul[horz.mFirst[x] * 4];
+			int			acc[4]	= { 0, 0, 0, 0 };
+
+			for (qlong k = 0; k < horz.mCount[x]; k++) {
+				acc[0] += weights[k] * in[0];
+				acc[1] += weights[k] * in[1];
+				acc[2] += weights[k] * in[2];
+				acc[3] += weights[k] * in[3];
+				in += 4;
+			};
+
+			for (int c = 0; c < 4; c++) {
+				int	value = (acc[c] + (1 << (OIMG_WEIGHTBITS - OIMG_MIDBITS - 1))) >> (OIMG_WEIGHTBITS - OIMG_MIDBITS);
+				out[(x * 4) + c] = (unsigned short) (value < 0 ? 0 : (value > (255 << OIMG_MIDBITS) ? (255 << OIMG_MIDBITS) : value));
+			};
+		};
+	};
+
+	// vertical pass, we accumulate a whole row at a time which keeps our inner loop simple enough to vectorise
+	qlong				rowlen = pDestWidth * 4;
+	std::vector<int>	acc(rowlen);
+	const int			shift = OIMG_WEIGHTBITS + OIMG_MIDBITS;
+
+	for (qlong y = 0; y < pDestHeight; y++) {
+		const int *	weights = &vert.mWeights[y * vert.mTaps];
+
+		std::fill(acc.begin(), acc.end(), 1 << (shift - 1));
+		for (qlong k = 0; k < vert.mCount[y]; k++) {
+			const unsigned short *	in		= &mid[(vert.mFirst[y] + k) * rowlen];
+			int						weight	= weights[k];
+			for (qlong i = 0; i < rowlen; i++) {
+				acc[i] += weight * in[i];
+			};
+		};
+
+		// clamp and unpremultiply
+		sPixel *	out = pDest + (y * pDestWidth);
+		for (qlong x = 0; x < pDestWidth; x++) {
+			int	a = acc[(x * 4) + 3] >> shift;
+			a = a < 0 ? 0 : (a > 255 ? 255 : a);
+			out[x].mA = (qbyte) a;
+
+			if (a == 0) {
+				out[x].mR = 0;
+				out[x].mG = 0;
+				out[x].mB = 0;
+			} else {
+				for (int c = 0; c < 3; c++) {
+					int	value = acc[(x * 4) + c] >> shift;
+					value = value < 0 ? 0 : (value > a ? a : value);
+					value = ((value * 255) + (a / 2)) / a;
+
+					switch (c) {
+						case 0: out[x].mR = (qbyte) value; break;
+						case 1: out[x].mG = (qbyte) value; break;
+						default: out[x].mB = (qbyte) value; break;
+					};
+				};
+			};
+		};
+	};
+};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // oImgLayer
@@ -30,6 +256,10 @@ oImgLayer::oImgLayer(void) {
 	mWidth		= 0;	// 0 = autosize
 	mHeight		= 0;	// 0 = autosize
 	mAlpha		= 255;	// 255 = fully opaque
+	mFilter		= oIMF_bilinear;
+	mEncodeCount	= 0;
+	mDecodeScale	= 1;
+	mReady		= false;
 };
 
 oImgLayer::~oImgLayer(void) {
@@ -80,30 +310,247 @@ void	oImgLayer::setHeight(qlong pNewValue) {
 	mHeight = pNewValue;
 };
 
-void	oImgLayer::getContents(EXTfldval &pContents) {
+qlong	oImgLayer::filter() {
+	return mFilter;
+};
+
+void	oImgLayer::setFilter(qlong pNewValue) {
+	if ((pNewValue >= oIMF_box) && (pNewValue <= oIMF_lanczos)) {
+		mFilter = pNewValue;
+	};
+};
+
+qlong	oImgLayer::decodeScale() {
+	return mDecodeScale;
+};
+
+void	oImgLayer::setDecodeScale(qlong pNewValue) {
+	if ((pNewValue == 0) || (pNewValue == 1) || (pNewValue == 2) || (pNewValue == 4) || (pNewValue == 8)) {
+		mDecodeScale = pNewValue;
+	};
+};
+
+void	oImgLayer::getContents(EXTfldval &pContents, qlong pCompression) {
 	pContents.setEmpty(fftBinary, 0);
 };
 
-void	oImgLayer::setContents(EXTfldval &pContents) {
+void	oImgLayer::setContents(EXTfldval &pContents, qlong pMaxPixels) {
 	// nothing to do here...
 };
 
-// draw our layer onto the pixmap..
-void	oImgLayer::drawLayer(oRGBAImage & pOnto, bool pMix) {
+// number of times we've encoded our contents
+qlong	oImgLayer::encodeCount() {
+	return mEncodeCount;
+};
+
+// area our layer covers
+sImgRect	oImgLayer::bounds() {
+	sImgRect	area;
+
+	area.mLeft		= left();
+	area.mTop		= top();
+	area.mRight		= area.mLeft + width();
+	area.mBottom	= area.mTop + height();
+
+	return area;
+};
+
+// get everything ready so drawLayer can be called from multiple threads at once
+void	oImgLayer::prepareLayer(oRGBAImage & pOnto, const sImgRect & pClip) {
+	// nothing to draw..
+	mReady = false;
+};
+
+// draw the part of our layer within pClip onto the pixmap..
+void	oImgLayer::drawLayer(oRGBAImage & pOnto, bool pMix, const sImgRect & pClip) {
 	// nothing to do here..
 };	
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// row kernels
+//
+// Our blend works on 8 bit integers so every kernel gives exactly the same result:
+//   a		= src.a * alpha / 255
+//   dst.c	= (src.c * a + dst.c * (255 - a)) / 255		for r, g and b
+//   dst.a	= (255 * a + dst.a * (255 - a)) / 255
+// Divisions by 255 are rounded with (x + 128 + ((x + 128) >> 8)) >> 8 which is exact for x <= 255 * 255
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline qbyte	oImgDiv255(unsigned int pValue) {
+	pValue += 128;
+	return (qbyte) ((pValue + (pValue >> 8)) >> 8);
+};
+
+static inline void	oImgMixPixel(sPixel & pDest, const sPixel & pSource, unsigned int pAlpha) {
+	unsigned int	a		= oImgDiv255(pSource.mA * pAlpha);
+	unsigned int	inv		= 255 - a;
+
+	pDest.mR = oImgDiv255((pSource.mR * a) + (pDest.mR * inv));
+	pDest.mG = oImgDiv255((pSource.mG * a) + (pDest.mG * inv));
+	pDest.mB = oImgDiv255((pSource.mB * a) + (pDest.mB * inv));
+	pDest.mA = oImgDiv255((255 * a) + (pDest.mA * inv));
+};
+
+#if defined(OIMG_SSE2) || defined(OIMG_AVX2)
+// 16 bit lanes are r, g, b, a per pixel, the alpha channel sits in lane 3 of every 4
+#define OIMG_DIV255(x, add, srli, shift)	srli(add(add(x, mRound), srli(add(x, mRound), shift)), shift)
+#endif
+
+#if defined(OIMG_AVX2)
+// blend two pixels per 128 bit lane half, 8 pixels per call
+static inline __m256i	oImgMixAVX2(__m256i pDest, __m256i pSource, __m256i pAlpha, __m256i pAlphaMask) {
+	const __m256i	mRound	= _mm256_set1_epi16(128);
+	const __m256i	m255	= _mm256_set1_epi16(255);
+	__m256i			zero	= _mm256_setzero_si256();
+	__m256i			result[2];
+
+	for (int half = 0; half < 2; half++) {
+		__m256i	src = half == 0 ? _mm256_unpacklo_epi8(pSource, zero) : _mm256_unpackhi_epi8(pSource, zero);
+		__m256i	dst = half == 0 ? _mm256_unpacklo_epi8(pDest, zero) : _mm256_unpackhi_epi8(pDest, zero);
+
+		// broadcast source alpha over the pixel and scale it by our layer alpha
+		__m256i	a	= _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+		a			= _mm256_mullo_epi16(a, pAlpha);
+		a			= OIMG_DIV255(a, _mm256_add_epi16, _mm256_srli_epi16, 8);
+		__m256i	inv	= _mm256_sub_epi16(m255, a);
+
+		// blend as if our source alpha is 255 so the alpha lane follows the same formula
+		src			= _mm256_or_si256(src, pAlphaMask);
+		__m256i	sum	= _mm256_add_epi16(_mm256_mullo_epi16(src, a), _mm256_mullo_epi16(dst, inv));
+		result[half] = OIMG_DIV255(sum, _mm256_add_epi16, _mm256_srli_epi16, 8);
+	};
+
+	return _mm256_packus_epi16(result[0], result[1]);
+};
+#endif
+
+#if defined(OIMG_SSE2)
+// blend 4 pixels
+static inline __m128i	oImgMixSSE2(__m128i pDest, __m128i pSource, __m128i pAlpha, __m128i pAlphaMask) {
+	const __m128i	mRound	= _mm_set1_epi16(128);
+	const __m128i	m255	= _mm_set1_epi16(255);
+	__m128i			zero	= _mm_setzero_si128();
+	__m128i			result[2];
+
+	for (int half = 0; half < 2; half++) {
+		__m128i	src = half == 0 ? _mm_unpacklo_epi8(pSource, zero) : _mm_unpackhi_epi8(pSource, zero);
+		__m128i	dst = half == 0 ? _mm_unpacklo_epi8(pDest, zero) : _mm_unpackhi_epi8(pDest, zero);
+
+		// broadcast source alpha over the pixel and scale it by our layer alpha
+		__m128i	a	= _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+		a			= _mm_mullo_epi16(a, pAlpha);
+		a			= OIMG_DIV255(a, _mm_add_epi16, _mm_srli_epi16, 8);
+		__m128i	inv	= _mm_sub_epi16(m255, a);
+
+		// blend as if our source alpha is 255 so the alpha lane follows the same formula
+		src			= _mm_or_si128(src, pAlphaMask);
+		__m128i	sum	= _mm_add_epi16(_mm_mullo_epi16(src, a), _mm_mullo_epi16(dst, inv));
+		result[half] = OIMG_DIV255(sum, _mm_add_epi16, _mm_srli_epi16, 8);
+	};
+
+	return _mm_packus_epi16(result[0], result[1]);
+};
+#endif
+
+#if defined(OIMG_NEON)
+static inline uint8x8_t	oImgDiv255NEON(uint16x8_t pValue) {
+	// (x + ((x + 128) >> 8) + 128) >> 8, same rounding as oImgDiv255
+	return vrshrn_n_u16(vrsraq_n_u16(pValue, pValue, 8), 8);
+};
+#endif
+
+// copy a row of pixels
+void	oImgLayer::copyRow(sPixel * pDest, const sPixel * pSource, qlong pCount) {
+	if (pCount > 0) {
+		memcpy(pDest, pSource, sizeof(sPixel) * pCount);
+	};
+};
+
+// alpha blend a row of pixels onto pDest
+void	oImgLayer::mixRow(sPixel * pDest, const sPixel * pSource, qlong pCount, qbyte pAlpha) {
+	qlong	x = 0;
+
+	if (pAlpha == 0) {
+		// layer is fully transparent
+		return;
+	};
+
+#if defined(OIMG_AVX2)
+	if (pCount >= 8) {
+		__m256i	alpha256	= _mm256_set1_epi16(pAlpha);
+		__m256i	mask256		= _mm256_set1_epi64x(0x00FF000000000000LL);
+
+		for (; x + 8 <= pCount; x += 8) {
+			__m256i	src = _mm256_loadu_si256((const __m256i *) (pSource + x));
+			__m256i	dst = _mm256_loadu_si256((const __m256i *) (pDest + x));
+			_mm256_storeu_si256((__m256i *) (pDest + x), oImgMixAVX2(dst, src, alpha256, mask256));
+		};
+	};
+#endif
+#if defined(OIMG_SSE2)
+	if (pCount - x >= 4) {
+		__m128i	alpha128	= _mm_set1_epi16(pAlpha);
+		__m128i	mask128		= _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+		for (; x + 4 <= pCount; x += 4) {
+			__m128i	src = _mm_loadu_si128((const __m128i *) (pSource + x));
+			__m128i	dst = _mm_loadu_si128((const __m128i *) (pDest + x));
+			_mm_storeu_si128((__m128i *) (pDest + x), oImgMixSSE2(dst, src, alpha128, mask128));
+		};
+	};
+#elif defined(OIMG_NEON)
+	if (pCount >= 8) {
+		uint8x8_t	alpha8	= vdup_n_u8(pAlpha);
+		uint8x8_t	max8	= vdup_n_u8(255);
+
+		for (; x + 8 <= pCount; x += 8) {
+			uint8x8x4_t	src	= vld4_u8((const uint8_t *) (pSource + x));
+			uint8x8x4_t	dst	= vld4_u8((const uint8_t *) (pDest + x));
+			uint8x8_t	a	= oImgDiv255NEON(vmull_u8(src.val[3], alpha8));
+			uint8x8_t	inv	= vsub_u8(max8, a);
+
+			dst.val[0] = oImgDiv255NEON(vmlal_u8(vmull_u8(src.val[0], a), dst.val[0], inv));
+			dst.val[1] = oImgDiv255NEON(vmlal_u8(vmull_u8(src.val[1], a), dst.val[1], inv));
+			dst.val[2] = oImgDiv255NEON(vmlal_u8(vmull_u8(src.val[2], a), dst.val[2], inv));
+			dst.val[3] = oImgDiv255NEON(vmlal_u8(vmull_u8(max8, a), dst.val[3], inv));
+
+			vst4_u8((uint8_t *) (pDest + x), dst);
+		};
+	};
+#endif
+
+	// and whatever is left over
+	for (; x < pCount; x++) {
+		oImgMixPixel(pDest[x], pSource[x], pAlpha);
+	};
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // oImgBitmap
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+qulong	oImgBitmap::sNextContentsID = 1;
+
 // init as empty bitmap
 oImgBitmap::oImgBitmap(qlong pWidth, qlong pHeight, qcol pColor) {
-	mImage = new oRGBAImage(pWidth, pHeight, pColor);
+	mImage			= new oRGBAImage(pWidth, pHeight, pColor);
+	mContentsID		= sNextContentsID++;
+	mScaledID		= 0;
+	mScaledWidth	= 0;
+	mScaledHeight	= 0;
+	mScaledFilter	= -1;
+	mEncoded		= NULL;
+	mEncodedLen		= 0;
+	mEncodedID		= 0;
+	mEncodedCompression = oIMC_best;
 };
 
 oImgBitmap::~oImgBitmap() {
+	if (mEncoded != NULL) {
+		free(mEncoded);
+		mEncoded = NULL;
+	};
 	if (mImage != NULL) {
 		delete mImage;
 		mImage = NULL;
@@ -154,151 +601,347 @@ void	oImgBitmap::setHeight(qlong pNewValue) {
 	};
 };
 
-void	oImgBitmap::getContents(EXTfldval &pContents) {
+void	oImgBitmap::getContents(EXTfldval &pContents, qlong pCompression) {
 	if (mImage == NULL) {
 		pContents.setEmpty(fftBinary, 0);		
 	} else {
-		int				len = 0;
-		unsigned char *	pngdata = mImage->asPNG(len);
+		if ((mEncoded == NULL) || (mEncodedID != mContentsID) || (mEncodedCompression != pCompression)) {
+			// our contents changed since we last encoded them
+			if (mEncoded != NULL) {
+				free(mEncoded);
+				mEncoded = NULL;
+			};
+			mEncodedLen	= 0;
+			mEncoded	= oImgEncoder::encodePNG(mImage->imagebuffer(), mImage->width(), mImage->height(), pCompression, mEncodedLen);
+			mEncodedID	= mContentsID;
+			mEncodedCompression = pCompression;
+			mEncodeCount++;
+		};
 
-		if (pngdata == NULL) {
+		if (mEncoded == NULL) {
 			oBaseComponent::addToTraceLog("getContents: No image");
 			pContents.setEmpty(fftBinary, 0);		
 		} else {
-			pContents.setBinary(fftBinary, pngdata, len);
+			pContents.setBinary(fftBinary, mEncoded, mEncodedLen);
+		};
+	};
+};
+
+// free our scaled and encoded copies of our image
+void	oImgBitmap::releaseCaches() {
+	std::vector<sPixel>().swap(mScaled);
+	mScaledID = 0;
+
+	if (mEncoded != NULL) {
+		free(mEncoded);
+		mEncoded	= NULL;
+		mEncodedLen	= 0;
+	};
+};
+
+// get the size of an encoded image from its header
+bool	oImgBitmap::probeSize(const qbyte * pData, qlong pLen, qlong & pWidth, qlong & pHeight) {
+	if (oImgEncoder::rawSize(pData, pLen, pWidth, pHeight)) {
+		return true;
+	} else if ((pLen >= 24) && (memcmp(pData, "\x89PNG\r\n\x1a\n", 8) == 0) && (memcmp(pData + 12, "IHDR", 4) == 0)) {
+		pWidth	= ((qlong) pData[16] << 24) | ((qlong) pData[17] << 16) | ((qlong) pData[18] << 8) | pData[19];
+		pHeight	= ((qlong) pData[20] << 24) | ((qlong) pData[21] << 16) | ((qlong) pData[22] << 8) | pData[23];
+		return true;
+	} else if ((pLen >= 10) && ((memcmp(pData, "GIF87a", 6) == 0) || (memcmp(pData, "GIF89a", 6) == 0))) {
+		pWidth	= pData[6] | (pData[7] << 8);
+		pHeight	= pData[8] | (pData[9] << 8);
+		return true;
+	} else if ((pLen >= 26) && (pData[0] == 'B') && (pData[1] == 'M')) {
+		pWidth	= (qlong) (pData[18] | (pData[19] << 8) | (pData[20] << 16) | ((qulong) pData[21] << 24));
+		pHeight	= (qlong) (pData[22] | (pData[23] << 8) | (pData[24] << 16) | ((qulong) pData[25] << 24));
+		if (pHeight < 0) pHeight = -pHeight;		// top down bitmap
+		return true;
+	} else if ((pLen >= 4) && (pData[0] == 0xFF) && (pData[1] == 0xD8)) {
+		// JPEG, walk our markers until we find our frame header
+		qlong	pos = 2;
+		while (pos + 4 <= pLen) {
+			if (pData[pos] != 0xFF) {
+				return false;
+			};
+
+			qbyte	marker = pData[pos + 1];
+			if (marker == 0xFF) {
+				// fill byte
+				pos++;
+			} else if ((marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD9))) {
+				// markers without a length
+				pos += 2;
+			} else if ((marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC)) {
+				if (pos + 9 > pLen) {
+					return false;
+				};
+				pHeight	= (pData[pos + 5] << 8) | pData[pos + 6];
+				pWidth	= (pData[pos + 7] << 8) | pData[pos + 8];
+				return true;
+			} else {
+				pos += 2 + ((pData[pos + 2] << 8) | pData[pos + 3]);
+			};
+		};
+	};
+
+	// unknown format or not enough data
+	return false;
+};
+
+// factor by which to reduce the image we just decoded
+qlong	oImgBitmap::decodeFactor() {
+	if (mDecodeScale != 0) {
+		return mDecodeScale;
+	};
+
+	// reduce by the largest power of two that still leaves us at least at our layer size so our final resample has enough to work with
+	qlong	factor = 1;
+	if ((mWidth > 0) && (mHeight > 0)) {
+		while ((factor < 8) && (mImage->width() / (factor * 2) >= mWidth) && (mImage->height() / (factor * 2) >= mHeight)) {
+			factor *= 2;
+		};
+	};
+	return factor;
+};
+
+// shrink our image by averaging blocks of pFactor x pFactor pixels
+void	oImgBitmap::reduceImage(qlong pFactor) {
+	qlong	sourcewidth		= mImage->width();
+	qlong	sourceheight	= mImage->height();
+	qlong	width			= (sourcewidth + pFactor - 1) / pFactor;
+	qlong	height			= (sourceheight + pFactor - 1) / pFactor;
+
+	if ((pFactor <= 1) || (sourcewidth == 0) || (sourceheight == 0)) {
+		return;
+	};
+
+	oRGBAImage *	image = new oRGBAImage(width, height);
+	if (image == NULL) {
+		return;
+	};
 
-			free(pngdata);
+	// colors are weighted by alpha so transparent pixels don't darken our edges
+	std::vector<qulong>	sums(width * 5);
+	const sPixel *		source	= mImage->imagebuffer();
+	sPixel *			dest	= image->imagebuffer();
+
+	for (qlong y = 0; y < height; y++) {
+		std::fill(sums.begin(), sums.end(), 0);
+
+		qlong	lastrow = (y + 1) * pFactor > sourceheight ? sourceheight : (y + 1) * pFactor;
+		for (qlong sy = y * pFactor; sy < lastrow; sy++) {
+			const sPixel *	row = source + (sy * sourcewidth);
+			for (qlong sx = 0; sx < sourcewidth; sx++) {
+				qulong *	sum	= &sums[(sx / pFactor) * 5];
+				qulong		a	= row[sx].mA;
+				sum[0] += row[sx].mR * a;
+				sum[1] += row[sx].mG * a;
+				sum[2] += row[sx].mB * a;
+				sum[3] += a;
+				sum[4]++;
+			};
+		};
+
+		for (qlong x = 0; x < width; x++) {
+			qulong *	sum		= &sums[x * 5];
+			sPixel &	pixel	= dest[(y * width) + x];
+			pixel.mA = (qbyte) ((sum[3] + (sum[4] / 2)) / sum[4]);
+			if (sum[3] == 0) {
+				pixel.mR = 0;
+				pixel.mG = 0;
+				pixel.mB = 0;
+			} else {
+				pixel.mR = (qbyte) ((sum[0] + (sum[3] / 2)) / sum[3]);
+				pixel.mG = (qbyte) ((sum[1] + (sum[3] / 2)) / sum[3]);
+				pixel.mB = (qbyte) ((sum[2] + (sum[3] / 2)) / sum[3]);
+			};
 		};
 	};
+
+	delete mImage;
+	mImage = image;
 };
 
-void	oImgBitmap::setContents(EXTfldval &pContents) {
+void	oImgBitmap::setContents(EXTfldval &pContents, qlong pMaxPixels) {
 	if (mImage == NULL) {
 		// really?
+		return;
+	};
+
+	// We get the binary as is, we assume the contents is raw picture data in any format supported by STB
+	qlong bitmapLen = pContents.getBinLen();
+	if (bitmapLen <= 0) {
+		oBaseComponent::addToTraceLog("setContents: No image specified");
+		return;
+	};
+
+	// EXTfldval doesn't give us access to its buffer so we can't decode in place. We do check the header before we copy
+	// the whole thing, the frame header of a JPEG can be further in so if we don't find it we check again after copying.
+	qlong	width = 0, height = 0;
+	bool	known = false;
+	{
+		qbyte	header[4096];
+		qlong	headerLen = 0;
+		pContents.getBinary(bitmapLen < 4096 ? bitmapLen : 4096, header, headerLen);
+		known = probeSize(header, headerLen, width, height);
+	};
+	if (known && (pMaxPixels > 0) && ((width <= 0) || (height <= 0) || ((double) width * (double) height > (double) pMaxPixels))) {
+		oBaseComponent::addToTraceLog("setContents: Image of %li x %li pixels exceeds our limit of %li pixels", width, height, pMaxPixels);
+		return;
+	};
+
+	// we're replacing our image, free what we can before we copy and decode
+	releaseCaches();
+
+	qbyte * bitmapData = (qbyte *)MEMmalloc(sizeof(qbyte) * (bitmapLen+1));
+	if (bitmapData == NULL) {
+		oBaseComponent::addToTraceLog("setContents: Couldn't allocate memory for pixel buffer");
+		return;
+	};
+
+	qlong	reallen;
+	pContents.getBinary(bitmapLen, bitmapData, reallen);
+
+	if (!known && (pMaxPixels > 0)) {
+		known = probeSize(bitmapData, reallen, width, height);
+		if (!known) {
+			// we can't tell how large this would decode, so we can't honour our limit
+			oBaseComponent::addToTraceLog("setContents: Couldn't read the size of our image to check it against our limit of %li pixels", pMaxPixels);
+			MEMfree(bitmapData);
+			return;
+		} else if ((width <= 0) || (height <= 0) || ((double) width * (double) height > (double) pMaxPixels)) {
+			oBaseComponent::addToTraceLog("setContents: Image of %li x %li pixels exceeds our limit of %li pixels", width, height, pMaxPixels);
+			MEMfree(bitmapData);
+			return;
+		};
+	};
+
+	qlong	rawwidth, rawheight;
+	if (oImgEncoder::rawSize(bitmapData, reallen, rawwidth, rawheight)) {
+		// our own raw format, no need to decode anything, rawSize has checked our data holds all our pixels
+		oRGBAImage *	image = new oRGBAImage(rawwidth, rawheight);
+		if ((image != NULL) && (image->imagebuffer() == NULL)) {
+			oBaseComponent::addToTraceLog("setContents: Couldn't allocate memory for pixel buffer");
+			delete image;
+		} else if (image != NULL) {
+			memcpy(image->imagebuffer(), bitmapData + OIMG_RAWHEADER, (size_t) rawwidth * (size_t) rawheight * 4);
+			delete mImage;
+			mImage = image;
+		};
 	} else {
-		// We get the binary as is, we assume the contents is raw picture data in any format supported by STB
-		qlong bitmapLen = pContents.getBinLen();
-		if (bitmapLen > 0) {
-			qbyte * bitmapData = (qbyte *)MEMmalloc(sizeof(qbyte) * (bitmapLen+1));
-			if (bitmapData != NULL) {
-				qlong	reallen;
-				pContents.getBinary(bitmapLen, bitmapData, reallen);
-
-				// and assign it to our image
-				mImage->copy(bitmapData, reallen);
-
-				// and free our memory
-				MEMfree(bitmapData);
-			} else {
-				oBaseComponent::addToTraceLog("setContents: Couldn't allocate memory for pixel buffer");
-			};
-		} else {
-			oBaseComponent::addToTraceLog("setContents: No image specified");
+		// and assign it to our image
+		mImage->copy(bitmapData, reallen);
+	};
+
+	// and free our memory before we reduce our image
+	MEMfree(bitmapData);
+	bitmapData = NULL;
+
+	// our decoder can't scale while decoding so we reduce right after, our full size image isn't kept around
+	reduceImage(decodeFactor());
+	mContentsID = sNextContentsID++;
+};
+
+// return our image at this size, only resamples if our cache is out of date
+const sPixel *	oImgBitmap::scaledPixels(qlong pWidth, qlong pHeight) {
+	if ((pWidth == mImage->width()) && (pHeight == mImage->height())) {
+		// no need to keep a scaled copy around
+		if (mScaledID != 0) {
+			std::vector<sPixel>().swap(mScaled);
+			mScaledID = 0;
 		};
+		return mImage->imagebuffer();
 	};
+
+	if ((mScaledID != mContentsID) || (mScaledWidth != pWidth) || (mScaledHeight != pHeight) || (mScaledFilter != mFilter)) {
+		mScaled.resize(pWidth * pHeight);
+		oImgResampler::resample(mImage->imagebuffer(), mImage->width(), mImage->height(), &mScaled[0], pWidth, pHeight, mFilter);
+
+		mScaledID		= mContentsID;
+		mScaledWidth	= pWidth;
+		mScaledHeight	= pHeight;
+		mScaledFilter	= mFilter;
+	};
+
+	return &mScaled[0];
 };
 
-// draw our layer onto the pixmap..
-void	oImgBitmap::drawLayer(oRGBAImage & pOnto, bool pMix) {
+// get everything ready so drawLayer can be called from multiple threads at once
+// we do all our checks (and their tracing) here as drawLayer may not call back into Omnis
+void	oImgBitmap::prepareLayer(oRGBAImage & pOnto, const sImgRect & pClip) {
+	mReady = false;
+
 	if (mImage == NULL) {
 		// nothing to draw..
 		oBaseComponent::addToTraceLog("drawLayer: No source image");
 		return;
 	};
 
-	// get the size of our destination bitmap
-	qlong	destwidth	= pOnto.width();
-	qlong	destheight	= pOnto.height();
-
-	if ((destwidth == 0) || (destheight == 0)) {
+	if ((pOnto.width() == 0) || (pOnto.height() == 0)) {
 		// nothing to draw..
 		oBaseComponent::addToTraceLog("drawLayer: Empty destination image");
 		return;
 	};
 
-	// get the size we want our bitmap to be
-	qlong	sourcewidth		= mImage->width();
-	qlong	sourceheight	= mImage->height();
-	qlong	scaledwidth		= width();
-	qlong	scaledheight	= height();
-
-	if ((sourcewidth==0) || (sourceheight==0)) {
+	if ((mImage->width() == 0) || (mImage->height() == 0)) {
 		// nothing to draw..
 		oBaseComponent::addToTraceLog("drawLayer: Empty source image");
 		return;
 	};
 
+	if ((width() <= 0) || (height() <= 0) || !bounds().intersects(pClip)) {
+		// nothing to draw here..
+		return;
+	};
+
+	// make sure our scaled cache is up to date, drawLayer only reads it after this
+	scaledPixels(width(), height());
+	mReady = true;
+};
+
+// draw the part of our layer within pClip onto the pixmap..
+void	oImgBitmap::drawLayer(oRGBAImage & pOnto, bool pMix, const sImgRect & pClip) {
+	if (!mReady) {
+		// prepareLayer found nothing to draw
+		return;
+	};
+
+	// get the size of our destination bitmap and the size we want our bitmap to be
+	qlong	destwidth		= pOnto.width();
+	qlong	destheight		= pOnto.height();
+	qlong	scaledwidth		= width();
+	qlong	scaledheight	= height();
+
+	// clip our layer against our destination and our clip rect once
+	qlong	minX = mLeft < 0 ? 0 : mLeft;
+	if (minX < pClip.mLeft) minX = pClip.mLeft;
 	qlong	maxX = (mLeft + scaledwidth);
 	if (maxX > destwidth) maxX = destwidth;
+	if (maxX > pClip.mRight) maxX = pClip.mRight;
 
+	qlong	minY = mTop < 0 ? 0 : mTop;
+	if (minY < pClip.mTop) minY = pClip.mTop;
 	qlong	maxY = (mTop + scaledheight);
 	if (maxY > destheight) maxY = destheight;
-		
-	if ((sourcewidth != scaledwidth) || (sourceheight != scaledheight)) {
-		// we're scaling this so we handle this slightly differently
-		// this code works well when enlarging our bitmap but is overkill for making things smaller
-		// look into using the resample logic available in STB, it may do a much better job, but thats for the next version...
-			
-		bool	issmaller = (sourcewidth > scaledwidth) && (sourceheight > scaledheight);
-			
-		float	stepX = (float) sourcewidth;
-		float	stepY = (float) sourceheight;
-				
-		stepX = stepX / scaledwidth;
-		stepY = stepY / scaledheight;
-				
-		float	sY = 0.0;
-				
-		for (qlong dY = mTop; dY < maxY; dY++) {
-			if (dY >= 0) {
-				float	sX = 0.0;
-						
-				for (qlong dX = mLeft; dX < maxX; dX++) {
-					if (dX >= 0)  {
-						sPixel pixel;
-						if (issmaller) {
-							// just get it
-							pixel = (* mImage)((qlong) floor(sX), (qlong) floor(sY));
-						} else {
-							// interpolate
-							pixel = mImage->getPixel(sX, sY);
-						};
-						if (pMix) {
-							pOnto(dX, dY) = oRGBAImage::mixPixel(pOnto(dX, dY), pixel, mAlpha);
-						} else {
-							pOnto(dX, dY) = pixel;
-						};
-					};
-							
-					sX += stepX;
-				};
-			};
-			sY += stepY;
-		}; 
-	} else {
-		// not scaled? just copy it!
-		qlong	sY = 0;
-				
-		for (qlong dY = mTop; dY < maxY; dY++) {
-			if (dY >= 0) {
-				qlong	sX = 0;
-				
-				for (qlong dX = mLeft; dX < maxX; dX++) {
-					if (dX >= 0)  {
-						sPixel	pixel = (*mImage)(sX, sY);
-						if (pMix) {
-							pOnto(dX, dY) = oRGBAImage::mixPixel(pOnto(dX, dY), pixel, mAlpha);
-						} else {
-							pOnto(dX, dY) = pixel;
-						};
-					};
-							
-					sX++;
-				};
-			};
-					
-			sY++;
-		};				
-	};			
-};	
+	if (maxY > pClip.mBottom) maxY = pClip.mBottom;
+
+	if ((minX >= maxX) || (minY >= maxY)) {
+		// layer is outside of our destination
+		return;
+	};
+
+	qlong			count		= maxX - minX;
+	sPixel *		destbuffer	= pOnto.imagebuffer();
+	const sPixel *	srcbuffer	= scaledPixels(scaledwidth, scaledheight);
+
+	for (qlong dY = minY; dY < maxY; dY++) {
+		sPixel *		dest	= destbuffer + (dY * destwidth) + minX;
+		const sPixel *	src		= srcbuffer + ((dY - mTop) * scaledwidth) + (minX - mLeft);
 
+		if (pMix) {
+			mixRow(dest, src, count, mAlpha);
+		} else {
+			copyRow(dest, src, count);
+		};
+	};
+};
\ No newline at end of file
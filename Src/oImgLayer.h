@@ -20,6 +20,45 @@
 #define oimglayerh
 
 #include "omnis.xcomp.framework.h"
+#include "oImgEncoder.h"
+#include <vector>
+
+enum oImgFilter {
+	oIMF_box				= 0,
+	oIMF_bilinear			= 1,
+	oIMF_bicubic			= 2,
+	oIMF_lanczos			= 3,
+};
+
+// rectangle in image pixels, right and bottom are exclusive
+struct sImgRect {
+	qlong					mLeft;
+	qlong					mTop;
+	qlong					mRight;
+	qlong					mBottom;
+	
+	bool					isEmpty() const { return (mLeft >= mRight) || (mTop >= mBottom); };
+	bool					intersects(const sImgRect & pOther) const { return (mLeft < pOther.mRight) && (pOther.mLeft < mRight) && (mTop < pOther.mBottom) && (pOther.mTop < mBottom); };
+	bool					touches(const sImgRect & pOther) const { return (mLeft <= pOther.mRight) && (pOther.mLeft <= mRight) && (mTop <= pOther.mBottom) && (pOther.mTop <= mBottom); };
+};
+
+// separable two pass resampler, weights are precomputed per output row/column in 14 bit fixed point
+class oImgResampler {
+private:
+	struct sWeights {
+		qlong				mTaps;												// max number of source pixels contributing to one output pixel
+		std::vector<qlong>	mFirst;												// first source pixel for each output pixel
+		std::vector<qlong>	mCount;												// number of source pixels for each output pixel
+		std::vector<int>	mWeights;											// mTaps weights for each output pixel, these add up to 1 << 14
+	};
+
+	static	double			filterSupport(qlong pFilter);						// radius of our filter at scale 1
+	static	double			filterWeight(qlong pFilter, double pX);				// weight of our filter at distance pX
+	static	void			buildWeights(sWeights & pWeights, qlong pSource, qlong pDest, qlong pFilter);
+	
+public:
+	static	void			resample(const sPixel * pSource, qlong pSourceWidth, qlong pSourceHeight, sPixel * pDest, qlong pDestWidth, qlong pDestHeight, qlong pFilter);
+};
 
 class oImgLayer {
 private:
@@ -30,6 +69,10 @@ protected:
 	qlong		mWidth;
 	qlong		mHeight;
 	qbyte		mAlpha;
+	qlong		mFilter;													// filter used when scaling this layer
+	qlong		mEncodeCount;												// number of times we've encoded our contents
+	qlong		mDecodeScale;												// factor by which we reduce images we decode, 0 = reduce to our layer size
+	bool		mReady;														// set by prepareLayer when we have something to draw
 	
 public:
 	oImgLayer(void);
@@ -47,16 +90,44 @@ public:
 	virtual		void		setWidth(qlong pNewValue);
 	virtual		qlong		height();
 	virtual		void		setHeight(qlong pNewValue);	
+	virtual		qlong		filter();
+	virtual		void		setFilter(qlong pNewValue);
+	virtual		qlong		decodeScale();
+	virtual		void		setDecodeScale(qlong pNewValue);
 	
-	virtual		void		getContents(EXTfldval &pContents);
-	virtual		void		setContents(EXTfldval &pContents);
+	virtual		void		getContents(EXTfldval &pContents, qlong pCompression);	// get our contents encoded as PNG
+	virtual		void		setContents(EXTfldval &pContents, qlong pMaxPixels);		// set our contents from an encoded image, images larger than pMaxPixels or whose size we can't read are refused (0 = no limit)
+				qlong		encodeCount();												// number of times we've encoded our contents
 	
-	virtual		void		drawLayer(oRGBAImage & pOnto, bool pMix);	// draw our layer onto the pixmap..
+	virtual		sImgRect	bounds();													// area our layer covers
+	virtual		void		prepareLayer(oRGBAImage & pOnto, const sImgRect & pClip);	// get everything ready so drawLayer can be called from multiple threads at once
+	virtual		void		drawLayer(oRGBAImage & pOnto, bool pMix, const sImgRect & pClip);	// draw the part of our layer within pClip onto the pixmap..
+
+	static		void		copyRow(sPixel * pDest, const sPixel * pSource, qlong pCount);				// copy a row of pixels
+	static		void		mixRow(sPixel * pDest, const sPixel * pSource, qlong pCount, qbyte pAlpha);	// alpha blend a row of pixels onto pDest
 };
 
 class oImgBitmap : public oImgLayer {
 private:
-	oRGBAImage *	mImage;
+	static	qulong		sNextContentsID;								// source of our contents ids
+	
+	oRGBAImage *		mImage;
+	qulong				mContentsID;									// identifies the contents of mImage, changes whenever they are replaced
+	std::vector<sPixel>	mScaled;										// our image resampled to our layer size
+	qulong				mScaledID;										// contents id mScaled was resampled from
+	qlong				mScaledWidth;									// width mScaled was resampled to
+	qlong				mScaledHeight;									// height mScaled was resampled to
+	qlong				mScaledFilter;									// filter mScaled was resampled with
+	unsigned char *		mEncoded;										// our contents encoded as PNG
+	int					mEncodedLen;									// length of mEncoded
+	qulong				mEncodedID;										// contents id mEncoded was encoded from
+	qlong				mEncodedCompression;							// compression mEncoded was encoded with
+	
+	const sPixel *		scaledPixels(qlong pWidth, qlong pHeight);		// return our image at this size, only resamples if our cache is out of date
+	void				releaseCaches();								// free our scaled and encoded copies of our image
+	qlong				decodeFactor();									// factor by which to reduce the image we just decoded
+	void				reduceImage(qlong pFactor);						// shrink our image by averaging blocks of pFactor x pFactor pixels
+	static	bool		probeSize(const qbyte * pData, qlong pLen, qlong & pWidth, qlong & pHeight);	// get the size of an encoded image from its header
 	
 protected:
 public:
@@ -70,10 +141,11 @@ public:
 	virtual		qlong		height();
 	virtual		void		setHeight(qlong pNewValue);
 
-	virtual		void		getContents(EXTfldval &pContents);
-	virtual		void		setContents(EXTfldval &pContents);
+	virtual		void		getContents(EXTfldval &pContents, qlong pCompression);	// get our contents encoded as PNG
+	virtual		void		setContents(EXTfldval &pContents, qlong pMaxPixels);		// set our contents from an encoded image, images larger than pMaxPixels or whose size we can't read are refused (0 = no limit)
 
-	virtual		void		drawLayer(oRGBAImage & pOnto, bool pMix);	// draw our layer onto the pixmap..
+	virtual		void		prepareLayer(oRGBAImage & pOnto, const sImgRect & pClip);	// get everything ready so drawLayer can be called from multiple threads at once
+	virtual		void		drawLayer(oRGBAImage & pOnto, bool pMix, const sImgRect & pClip);	// draw the part of our layer within pClip onto the pixmap..
 };
 
 
@@ -0,0 +1,278 @@
+/*
+ *  omnis.xcomp.widget
+ *  ===================
+ *
+ *  oThread.cpp
+ *  Implementation of our thread support
+ *
+ *  Bastiaan Olij
+ */
+
+#include "oThread.h"
+
+#ifdef iswin32
+	#include <process.h>
+	#include <map>
+#else
+	#include <unistd.h>
+	#include <time.h>
+	#ifdef __APPLE__
+		#include <mach/mach_time.h>
+	#endif
+#endif
+
+////////////////////////////////////////////////
+// oAtomic
+////////////////////////////////////////////////
+
+oAtomic::oAtomic(long pValue) {
+	mValue = pValue;
+};
+
+// read our value
+long	oAtomic::get(void) {
+#ifdef iswin32
+	return InterlockedCompareExchange(&mValue, 0, 0);
+#else
+	return __sync_fetch_and_add(&mValue, 0);
+#endif
+};
+
+// change our value
+void	oAtomic::set(long pValue) {
+#ifdef iswin32
+	InterlockedExchange(&mValue, pValue);
+#else
+	long	was = mValue;
+
+	// a compare and swap is a full barrier, __sync_lock_test_and_set only acquires
+	while (!__sync_bool_compare_and_swap(&mValue, was, pValue)) {
+		was = mValue;
+	};
+#endif
+};
+
+// add to our value, returns our new value
+long	oAtomic::add(long pValue) {
+#ifdef iswin32
+	return InterlockedExchangeAdd(&mValue, pValue) + pValue;
+#else
+	return __sync_add_and_fetch(&mValue, pValue);
+#endif
+};
+
+////////////////////////////////////////////////
+// oThread
+////////////////////////////////////////////////
+
+oThread::oThread(void) {
+	mStarted	= false;
+	mFunction	= NULL;
+	mParam		= NULL;
+};
+
+oThread::~oThread(void) {
+	join();
+};
+
+// entry point of our thread
+#ifdef iswin32
+unsigned __stdcall	oThread::run(void * pThread) {
+	oThread *	thread = (oThread *) pThread;
+
+	thread->mFunction(thread->mParam);
+	return 0;
+};
+#else
+void *	oThread::run(void * pThread) {
+	oThread *	thread = (oThread *) pThread;
+
+	thread->mFunction(thread->mParam);
+	return NULL;
+};
+#endif
+
+// run pFunction(pParam) on a new thread, returns false if the thread couldn't be started
+bool	oThread::start(oThreadFunction pFunction, void * pParam) {
+	if (mStarted) {
+		// already running something
+		return false;
+	};
+
+	mFunction	= pFunction;
+	mParam		= pParam;
+
+#ifdef iswin32
+	// _beginthreadex instead of CreateThread so the runtime library is set up for our thread
+	mHandle = (HANDLE) _beginthreadex(NULL, 0, run, this, 0, NULL);
+	mStarted = mHandle != 0;
+#else
+	mStarted = pthread_create(&mThread, NULL, run, this) == 0;
+#endif
+
+	return mStarted;
+};
+
+// wait for our thread to finish
+void	oThread::join(void) {
+	if (!mStarted) {
+		return;
+	};
+
+#ifdef iswin32
+	WaitForSingleObject(mHandle, INFINITE);
+	CloseHandle(mHandle);
+#else
+	pthread_join(mThread, NULL);
+#endif
+	mStarted = false;
+};
+
+// number of cores we can run threads on
+unsigned int	oThread::hardwareConcurrency(void) {
+#ifdef iswin32
+	SYSTEM_INFO	info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long	cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cores > 0 ? (unsigned int) cores : 1;
+#endif
+};
+
+// let the calling thread sleep
+void	oThread::sleep(qulong pMilliseconds) {
+#ifdef iswin32
+	Sleep(pMilliseconds);
+#else
+	usleep(pMilliseconds * 1000);
+#endif
+};
+
+// milliseconds on a clock that doesn't jump when the system time changes, only useful for measuring time
+qulong	oThread::milliseconds(void) {
+#ifdef iswin32
+	return GetTickCount();
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t	timebase = { 0, 0 };
+
+	if (timebase.denom == 0) {
+		mach_timebase_info(&timebase);
+	};
+	return (qulong) ((mach_absolute_time() * timebase.numer / timebase.denom) / 1000000);
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (qulong) ((now.tv_sec * 1000) + (now.tv_nsec / 1000000));
+#endif
+};
+
+////////////////////////////////////////////////
+// oTimer
+////////////////////////////////////////////////
+
+#ifdef iswin32
+// our running timers, Windows only gives us the id of the timer that fired
+static std::map<UINT_PTR, oTimer *> &	runningTimers(void) {
+	static std::map<UINT_PTR, oTimer *>	timers;
+	
+	return timers;
+};
+#endif
+
+oTimer::oTimer(void) {
+#ifdef iswin32
+	mTimerID	= 0;
+#elif defined(__APPLE__)
+	mTimer		= NULL;
+#endif
+	mFunction	= NULL;
+	mParam		= NULL;
+};
+
+oTimer::~oTimer(void) {
+	stop();
+};
+
+// called by our platform when our timer fires
+#ifdef iswin32
+VOID CALLBACK	oTimer::run(HWND pHWnd, UINT pMsg, UINT_PTR pTimerID, DWORD pTime) {
+	std::map<UINT_PTR, oTimer *>::iterator	it = runningTimers().find(pTimerID);
+	
+	if (it != runningTimers().end()) {
+		it->second->mFunction(it->second->mParam);
+	};
+};
+#elif defined(__APPLE__)
+void	oTimer::run(CFRunLoopTimerRef pTimer, void * pTimerObj) {
+	oTimer *	timer = (oTimer *) pTimerObj;
+	
+	timer->mFunction(timer->mParam);
+};
+#endif
+
+// call pFunction(pParam) every pMilliseconds, must be called from our main thread, returns false if we couldn't set up a timer
+bool	oTimer::start(qulong pMilliseconds, oTimerFunction pFunction, void * pParam) {
+	stop();
+	
+	mFunction	= pFunction;
+	mParam		= pParam;
+	
+#ifdef iswin32
+	// a thread timer, our main thread's message loop calls us
+	mTimerID = SetTimer(NULL, 0, pMilliseconds, run);
+	if (mTimerID == 0) {
+		return false;
+	};
+	runningTimers()[mTimerID] = this;
+	
+	return true;
+#elif defined(__APPLE__)
+	CFRunLoopTimerContext	context = { 0, this, NULL, NULL, NULL };
+	CFAbsoluteTime			interval = pMilliseconds / 1000.0;
+	
+	mTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + interval, interval, 0, 0, run, &context);
+	if (mTimer == NULL) {
+		return false;
+	};
+	
+	// only in our default mode so we're not called while the user is tracking the mouse
+	CFRunLoopAddTimer(CFRunLoopGetMain(), mTimer, kCFRunLoopDefaultMode);
+	
+	return true;
+#else
+	// we have no main thread to call back on
+	return false;
+#endif
+};
+
+// stop calling our function
+void	oTimer::stop(void) {
+#ifdef iswin32
+	if (mTimerID != 0) {
+		KillTimer(NULL, mTimerID);
+		runningTimers().erase(mTimerID);
+		mTimerID = 0;
+	};
+#elif defined(__APPLE__)
+	if (mTimer != NULL) {
+		CFRunLoopTimerInvalidate(mTimer);
+		CFRelease(mTimer);
+		mTimer = NULL;
+	};
+#endif
+};
+
+// true if we're calling our function
+bool	oTimer::running(void) {
+#ifdef iswin32
+	return mTimerID != 0;
+#elif defined(__APPLE__)
+	return mTimer != NULL;
+#else
+	return false;
+#endif
+};
@@ -0,0 +1,115 @@
+/*
+ *  omnis.xcomp.widget
+ *  ===================
+ *
+ *  oThread.h
+ *  Header for our thread support
+ *
+ *  Our Studio 6 projects are built with compilers that predate C++11 so we can't use std::thread, std::atomic or std::chrono.
+ *  oThread wraps the threads of our platform, oAtomic is a value we can share between threads.
+ *  oTimer calls us back on our main thread while we wait for work running elsewhere to finish.
+ *
+ *  Bastiaan Olij
+ */
+
+#ifndef othreadh
+#define othreadh
+
+#include "omnis.xcomp.framework.h"
+
+#ifdef iswin32
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#ifdef __APPLE__
+		#include <CoreFoundation/CoreFoundation.h>
+	#endif
+#endif
+
+// a value we can share between threads, reads and writes are full barriers
+class oAtomic {
+private:
+#ifdef iswin32
+	volatile LONG		mValue;											// our value
+#else
+	volatile long		mValue;											// our value
+#endif
+
+	oAtomic(const oAtomic & pCopy);										// not copyable
+	oAtomic & operator=(const oAtomic & pCopy);
+
+public:
+	oAtomic(long pValue = 0);
+
+	long				get(void);										// read our value
+	void				set(long pValue);								// change our value
+	long				add(long pValue);								// add to our value, returns our new value
+};
+
+typedef void (*oThreadFunction)(void * pParam);
+
+// a thread running a function, started with start and waited for with join
+class oThread {
+private:
+#ifdef iswin32
+	HANDLE				mHandle;										// our thread
+#else
+	pthread_t			mThread;										// our thread
+#endif
+	bool				mStarted;										// true if we started a thread that we haven't joined yet
+	oThreadFunction		mFunction;										// function we run
+	void *				mParam;											// and the parameter we run it with
+
+	oThread(const oThread & pCopy);										// not copyable, we own our thread
+	oThread & operator=(const oThread & pCopy);
+
+#ifdef iswin32
+	static unsigned __stdcall	run(void * pThread);					// entry point of our thread
+#else
+	static void *		run(void * pThread);							// entry point of our thread
+#endif
+
+public:
+	oThread(void);
+	~oThread(void);														// joins our thread if it is still running
+
+	bool				start(oThreadFunction pFunction, void * pParam);	// run pFunction(pParam) on a new thread, returns false if the thread couldn't be started
+	void				join(void);										// wait for our thread to finish
+
+	static unsigned int	hardwareConcurrency(void);						// number of cores we can run threads on
+	static void			sleep(qulong pMilliseconds);					// let the calling thread sleep
+	static qulong		milliseconds(void);								// milliseconds on a clock that doesn't jump when the system time changes, only useful for measuring time
+};
+
+typedef void (*oTimerFunction)(void * pParam);
+
+// calls a function on our main thread at an interval until stopped, our calls are made in between handling other messages
+class oTimer {
+private:
+#ifdef iswin32
+	UINT_PTR			mTimerID;										// our timer, 0 if we're not running
+#elif defined(__APPLE__)
+	CFRunLoopTimerRef	mTimer;											// our timer, NULL if we're not running
+#endif
+	oTimerFunction		mFunction;										// function we call
+	void *				mParam;											// and the parameter we call it with
+
+	oTimer(const oTimer & pCopy);										// not copyable, we own our timer
+	oTimer & operator=(const oTimer & pCopy);
+
+#ifdef iswin32
+	static VOID CALLBACK	run(HWND pHWnd, UINT pMsg, UINT_PTR pTimerID, DWORD pTime);	// called by Windows when one of our timers fires
+#elif defined(__APPLE__)
+	static void			run(CFRunLoopTimerRef pTimer, void * pTimerObj);	// called by our run loop when our timer fires
+#endif
+
+public:
+	oTimer(void);
+	~oTimer(void);														// stops our timer
+
+	bool				start(qulong pMilliseconds, oTimerFunction pFunction, void * pParam);	// call pFunction(pParam) every pMilliseconds, must be called from our main thread, returns false if we couldn't set up a timer
+	void				stop(void);										// stop calling our function
+	bool				running(void);									// true if we're calling our function
+};
+
+#endif